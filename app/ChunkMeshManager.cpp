@@ -82,7 +82,8 @@ void ChunkMeshManager::FreeMeshes(std::span<ChunkAllocHandle> handles) {
 void ChunkMeshManager::UploadChunkMeshes(std::span<ChunkMeshUpload> uploads,
                                          std::vector<ChunkAllocHandle>& handles) {
   ZoneScoped;
-  for (const auto& [pos, mult, counts, staging_copy_idx, stale] : uploads) {
+  replaced_.clear();
+  for (const auto& [pos, mult, counts, staging_copy_idx, stale, replaces] : uploads) {
     ChunkDrawUniformData d{};
     // int mult = *CVarSystem::Get().GetIntCVar("chunks.chunk_mult");
     d.position = ivec4(pos, mult << 3);
@@ -97,8 +98,11 @@ void ChunkMeshManager::UploadChunkMeshes(std::span<ChunkMeshUpload> uploads,
     if (!stale) {
       handles.emplace_back(handle);
       quad_count_ += quad_cnt;
+      if (replaces) replaced_.emplace_back(replaces);
     }
   }
+  // Freed after the new meshes are added, both land in the same draw buffer update
+  if (!replaced_.empty()) FreeMeshes(replaced_);
   // {
   //   ZoneScopedN("copy to gpu");
   //   if (chunk_quad_buffer_.copies.size()) {
@@ -149,3 +153,39 @@ uint32_t ChunkMeshManager::CopyChunkToStaging(const uint64_t* data, uint32_t qua
 #endif
   return chunk_quad_buffer_.vertex_staging.Copy(data, quad_cnt * QuadSize);
 }
+
+QuadWord* ChunkMeshManager::ReserveStaging(uint32_t max_quads, uint32_t& staging_copy_idx) {
+  return static_cast<QuadWord*>(
+      chunk_quad_buffer_.vertex_staging.Reserve(max_quads * QuadSize, staging_copy_idx));
+}
+
+void ChunkMeshManager::CommitStaging(uint32_t staging_copy_idx, uint32_t quad_cnt) {
+  chunk_quad_buffer_.vertex_staging.Commit(staging_copy_idx, quad_cnt * QuadSize);
+}
+
+namespace {
+// Meshes that didn't fit in the staging ring, grown to the largest one, never shrunk
+thread_local std::vector<QuadWord> staging_mesh_scratch;
+}  // namespace
+
+QuadWord* StagingMeshSink::Reserve(uint32_t max_quads) {
+  reserved_ = false;
+  if (!max_quads) return nullptr;
+  if (auto* vertices = ChunkMeshManager::Get().ReserveStaging(max_quads, staging_copy_idx)) {
+    reserved_ = true;
+    return vertices;
+  }
+  const size_t words = static_cast<size_t>(max_quads) * QuadWordCount;
+  if (staging_mesh_scratch.size() < words) staging_mesh_scratch.resize(words);
+  return staging_mesh_scratch.data();
+}
+
+void StagingMeshSink::Commit(uint32_t quad_cnt) {
+  vertex_cnt = quad_cnt;
+  if (reserved_) {
+    ChunkMeshManager::Get().CommitStaging(staging_copy_idx, quad_cnt);
+  } else if (quad_cnt) {
+    staging_copy_idx =
+        ChunkMeshManager::Get().CopyChunkToStaging(staging_mesh_scratch.data(), quad_cnt);
+  }
+}
@@ -8,6 +8,7 @@
 #include "Types.hpp"
 #include "application/Renderer.hpp"
 #include "voxels/Common.hpp"
+#include "voxels/Mesher.hpp"
 #include "voxels/Types.hpp"
 
 struct StagingBufferPool;
@@ -23,6 +24,21 @@ struct ChunkDrawUniformData {
   bool operator==(const ChunkDrawUniformData& other) const { return position == other.position; }
 };
 
+// Mesher output written straight into the vertex staging ring, skipping the copy through
+// MesherOutputData. The mesher's bound is reserved and the unused tail given back on commit. If the
+// ring has no room the mesh goes to scratch owned by the worker thread and is copied into staging
+// at its exact size. staging_copy_idx is only valid if vertex_cnt > 0.
+class StagingMeshSink final : public MeshSink {
+ public:
+  QuadWord* Reserve(uint32_t max_quads) override;
+  void Commit(uint32_t quad_cnt) override;
+  uint32_t staging_copy_idx{};
+  uint32_t vertex_cnt{};
+
+ private:
+  bool reserved_{};
+};
+
 using ChunkAllocHandle = uint32_t;
 class ChunkMeshManager {
  public:
@@ -32,6 +48,10 @@ class ChunkMeshManager {
   void Cleanup();
   [[nodiscard]] uint32_t CopyChunkToStaging(const uint8_t* data, uint32_t quad_cnt);
   [[nodiscard]] uint32_t CopyChunkToStaging(const uint64_t* data, uint32_t quad_cnt);
+  // Null if the staging ring has no room for max_quads
+  [[nodiscard]] QuadWord* ReserveStaging(uint32_t max_quads, uint32_t& staging_copy_idx);
+  void CommitStaging(uint32_t staging_copy_idx, uint32_t quad_cnt);
+  // Appends the handles of uploads that aren't stale. Meshes they replace are freed.
   void UploadChunkMeshes(std::span<ChunkMeshUpload> uploads,
                          std::vector<ChunkAllocHandle>& handles);
   void FreeMeshes(std::span<ChunkAllocHandle> handles);
@@ -55,6 +75,7 @@ class ChunkMeshManager {
   VoxelRenderer* renderer_{};
 
   size_t quad_count_{};
+  std::vector<ChunkAllocHandle> replaced_;
   std::vector<AsyncTransfer> transfers_;
   tvk::AllocatedBuffer quad_index_buf_;
   tvk::AllocatedBuffer chunk_uniform_gpu_buf_;
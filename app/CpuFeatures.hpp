@@ -0,0 +1,70 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_X86_64
+#endif
+
+#ifdef CPU_X86_64
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// Functions using wider instruction sets than the build baseline are tagged with these and only
+// called after the matching runtime check below. MSVC doesn't need the attribute.
+#if defined(CPU_X86_64) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2,bmi,popcnt")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx2,bmi,popcnt")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+namespace cpu {
+
+#ifdef CPU_X86_64
+
+namespace detail {
+
+#ifdef _MSC_VER
+inline bool OSSavesYmm() { return (_xgetbv(0) & 0x6) == 0x6; }
+inline bool OSSavesZmm() { return (_xgetbv(0) & 0xE6) == 0xE6; }
+inline bool CpuidBit(int leaf, int reg, int bit) {
+  int regs[4];
+  __cpuidex(regs, leaf, 0);
+  return (regs[reg] >> bit) & 1;
+}
+#endif
+
+}  // namespace detail
+
+inline bool HasAVX2() {
+#ifdef _MSC_VER
+  static const bool has = detail::CpuidBit(1, 2, 27) && detail::OSSavesYmm() &&
+                          detail::CpuidBit(7, 1, 5);
+#else
+  static const bool has = __builtin_cpu_supports("avx2");
+#endif
+  return has;
+}
+
+inline bool HasAVX512() {
+#ifdef _MSC_VER
+  static const bool has = HasAVX2() && detail::OSSavesZmm() && detail::CpuidBit(7, 1, 16) &&
+                          detail::CpuidBit(7, 1, 30);
+#else
+  static const bool has =
+      HasAVX2() && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+  return has;
+}
+
+#else
+
+inline bool HasAVX2() { return false; }
+inline bool HasAVX512() { return false; }
+
+#endif
+
+}  // namespace cpu
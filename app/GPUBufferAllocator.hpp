@@ -234,11 +234,17 @@ class DynamicBuffer {
   }
 };
 
+// Mesh bytes on their way to the GPU. Worker threads write blocks into the mapped staging ring, the
+// frame that uploads a mesh copies its block out, and the block's bytes are only reused once that
+// frame's commands are done, see ReleaseInUse. Blocks that don't fit in the ring are kept on the
+// heap instead and copied out through a staging buffer of their own.
 struct TSVertexUploadRingBuffer {
  private:
   struct Block {
     size_t offset;
     size_t size;
+    // Bytes that didn't fit in the ring, offset is unused if set
+    std::vector<uint8_t> spill;
   };
 
  public:
@@ -247,51 +253,73 @@ struct TSVertexUploadRingBuffer {
     ring_buf_.Init(size);
   }
 
+  // Reserves size_bytes of the mapped staging buffer for the caller to write into directly, e.g.
+  // the mesher. Null if the ring has no room. Commit must follow with the bytes actually written.
+  [[nodiscard]] void* Reserve(uint32_t size_bytes, uint32_t& copy_idx) {
+    ZoneScoped;
+    std::lock_guard<std::mutex> lock(mtx);
+    const size_t offset = ring_buf_.Allocate(size_bytes);
+    if (offset == NonOwningRingBuffer::Full) return nullptr;
+    copy_idx = AddBlock({.offset = offset, .size = size_bytes});
+    return reinterpret_cast<unsigned char*>(staging_.data) + offset;
+  }
+
+  // Trims a reservation to size_bytes, the rest goes back to the ring. An empty commit releases
+  // the block.
+  void Commit(uint32_t copy_idx, uint32_t size_bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    EASSERT(copy_idx < copies_.size());
+    auto& block = copies_[copy_idx];
+    EASSERT(size_bytes <= block.size);
+    if (size_bytes == 0) {
+      ReleaseBlock(copy_idx);
+      return;
+    }
+    ring_buf_.Shrink(block.offset, size_bytes);
+    block.size = size_bytes;
+  }
+
   template <typename T>
   [[nodiscard]] uint32_t Copy(const T* data, uint32_t size_bytes) {
     ZoneScoped;
     EASSERT(data && size_bytes > 0);
-    size_t offset;
-    size_t alloc_size_bytes = size_bytes;
-    {
-      ZoneScopedN("acquire offset in copy");
-      std::lock_guard<std::mutex> lock(mtx);
-      offset = ring_buf_.Allocate(alloc_size_bytes);
-    }
-    auto* start = reinterpret_cast<unsigned char*>(staging_.data);
-    memcpy(start + offset, data, alloc_size_bytes);
-
     uint32_t copy_idx;
-    {
-      ZoneScopedN("get copy index lock");
-      std::lock_guard<std::mutex> lock(mtx);
-      if (free_copy_indices_.size()) {
-        copy_idx = free_copy_indices_.back();
-        free_copy_indices_.pop_back();
-      } else {
-        copy_idx = copies_.size();
-        copies_.emplace_back();
-      }
+    if (void* dst = Reserve(size_bytes, copy_idx)) {
+      memcpy(dst, data, size_bytes);
+      return copy_idx;
     }
-
-    copies_[copy_idx] = Block{.offset = offset, .size = alloc_size_bytes};
-    return copy_idx;
+    std::vector<uint8_t> spill(size_bytes);
+    memcpy(spill.data(), data, size_bytes);
+    std::lock_guard<std::mutex> lock(mtx);
+    return AddBlock({.offset = 0, .size = size_bytes, .spill = std::move(spill)});
   }
 
-  // worker threads add copies to the staging buffer
-  // staging buffer is flushed to the GPU every frame
-  void GetBlock(uint32_t copy_idx, size_t& offset, size_t& size) {
+  void GetBlock(uint32_t copy_idx, size_t& offset, size_t& size, bool& spilled) {
     ZoneScoped;
     std::lock_guard<std::mutex> lock(mtx);
     EASSERT(copy_idx < copies_.size());
     offset = copies_[copy_idx].offset;
     size = copies_[copy_idx].size;
+    spilled = !copies_[copy_idx].spill.empty();
   }
 
-  void Reset() {
+  // Writes the bytes of a block kept on the heap to dst.
+  void ReadSpill(uint32_t copy_idx, void* dst) {
     std::lock_guard<std::mutex> lock(mtx);
-    free_copy_indices_.reserve(free_copy_indices_.size() + in_use_.size());
-    free_copy_indices_.insert(free_copy_indices_.end(), in_use_.begin(), in_use_.end());
+    EASSERT(copy_idx < copies_.size());
+    const auto& spill = copies_[copy_idx].spill;
+    memcpy(dst, spill.data(), spill.size());
+  }
+
+  // Blocks handed to AddInUseCopy since the last call are released once del_queue is flushed,
+  // after the GPU is done with the frame that copies them out.
+  void ReleaseInUse(tvk::DeletionQueue& del_queue) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (in_use_.empty()) return;
+    del_queue.PushFunc([this, in_use = std::move(in_use_)]() {
+      std::lock_guard<std::mutex> lock(mtx);
+      for (uint32_t copy_idx : in_use) ReleaseBlock(copy_idx);
+    });
     in_use_.clear();
   }
 
@@ -310,6 +338,29 @@ struct TSVertexUploadRingBuffer {
   std::mutex mtx;
 
  private:
+  uint32_t AddBlock(Block block) {
+    uint32_t copy_idx;
+    if (free_copy_indices_.size()) {
+      copy_idx = free_copy_indices_.back();
+      free_copy_indices_.pop_back();
+    } else {
+      copy_idx = copies_.size();
+      copies_.emplace_back();
+    }
+    copies_[copy_idx] = std::move(block);
+    return copy_idx;
+  }
+
+  void ReleaseBlock(uint32_t copy_idx) {
+    auto& block = copies_[copy_idx];
+    if (block.spill.empty()) {
+      ring_buf_.Free(block.offset);
+    } else {
+      block.spill = {};
+    }
+    free_copy_indices_.emplace_back(copy_idx);
+  }
+
   std::vector<uint32_t> in_use_;
   NonOwningRingBuffer ring_buf_;
   tvk::AllocatedBuffer staging_;
@@ -329,6 +380,13 @@ struct VertexPool {
   TSVertexUploadRingBuffer vertex_staging;
   // TSVertexUploadRingBuffer<uint8_t> vertex_staging;
   std::vector<VkBufferCopy> copies;
+  // Uploads of blocks kept on the heap, see TSVertexUploadRingBuffer
+  struct SpillCopy {
+    uint32_t copy_idx;
+    VkDeviceSize dst_offset;
+    VkDeviceSize size;
+  };
+  std::vector<SpillCopy> spill_copies;
   size_t curr_copies_tot_size_bytes{};
   // TODO: refactor
 
@@ -469,26 +527,49 @@ struct VertexPool {
       return 0;
     }
     VkBufferCopy copy;
+    bool spilled;
     draws_dirty_ = true;
-    vertex_staging.GetBlock(copy_idx, copy.srcOffset, copy.size);
+    vertex_staging.GetBlock(copy_idx, copy.srcOffset, copy.size, spilled);
     uint32_t dst_offset;
     auto handle = draw_cmd_allocator.Allocate(copy.size, dst_offset, user_data);
 
     copy.dstOffset = dst_offset;
-    copies.emplace_back(copy);
+    if (spilled) {
+      spill_copies.push_back({copy_idx, copy.dstOffset, copy.size});
+    } else {
+      copies.emplace_back(copy);
+    }
     draw_cmds_count++;
     return handle;
   }
 
-  void ExecuteCopy(VkCommandBuffer cmd) {
+  // Records the copies of the meshes added since the last call. Their staging is released once
+  // del_queue, the frame's, is flushed.
+  void ExecuteCopy(VkCommandBuffer cmd, tvk::DeletionQueue& del_queue) {
     ZoneScoped;
     std::lock_guard<std::mutex> lock(mtx_);
     if (copies.size()) {
       vkCmdCopyBuffer(cmd, vertex_staging.Staging().buffer, quad_gpu_buf.buffer, copies.size(),
                       copies.data());
       copies.clear();
-      vertex_staging.Reset();
     }
+    if (spill_copies.size()) {
+      VkDeviceSize tot_size = 0;
+      for (const auto& spill : spill_copies) tot_size += spill.size;
+      auto staging = tvk::Allocator::Get().CreateStagingBuffer(tot_size);
+      std::vector<VkBufferCopy> regions;
+      regions.reserve(spill_copies.size());
+      VkDeviceSize offset = 0;
+      for (const auto& spill : spill_copies) {
+        vertex_staging.ReadSpill(spill.copy_idx, static_cast<uint8_t*>(staging.data) + offset);
+        regions.push_back({offset, spill.dst_offset, spill.size});
+        offset += spill.size;
+      }
+      vkCmdCopyBuffer(cmd, staging.buffer, quad_gpu_buf.buffer, regions.size(), regions.data());
+      del_queue.PushFunc([staging]() { tvk::Allocator::Get().DestroyBuffer(staging); });
+      spill_copies.clear();
+    }
+    vertex_staging.ReleaseInUse(del_queue);
   }
 
   [[nodiscard]] size_t CurrCopyOperationSize() const { return curr_copies_tot_size_bytes; }
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+
+// Read only view of a whole file through the OS page cache. Pages are faulted in on first touch,
+// so reading bytes through the view costs no copy. The view stays valid after the file is renamed
+// over or deleted, until Close. Windows refuses to rename over or delete a mapped file, there the
+// file has to be closed first.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  // False if the file is missing, empty or can't be mapped.
+  bool Open(const std::filesystem::path& path);
+  void Close();
+  [[nodiscard]] bool IsOpen() const { return data_ != nullptr; }
+  [[nodiscard]] std::span<const uint8_t> Bytes() const { return {data_, size_}; }
+
+ private:
+  const uint8_t* data_{};
+  size_t size_{};
+#ifdef _WIN32
+  void* mapping_{};
+#endif
+};
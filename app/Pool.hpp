@@ -61,6 +61,8 @@ struct ObjPool {
   }
 };
 
+// Objects are allocated one by one and never move, so pointers from Get stay valid while the pool
+// grows. Alloc and Get aren't thread safe, threads other than the owner should be handed pointers.
 template <typename T>
 struct PtrObjPool {
   void Init(uint32_t size) {
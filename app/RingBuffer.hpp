@@ -1,24 +1,74 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+
+// Byte ranges of a buffer owned elsewhere, handed out in order. Ranges can be freed in any order,
+// but space is only reused once every range allocated before it is freed too, so an allocation
+// never overlaps a range still held. Not thread safe.
 struct NonOwningRingBuffer {
+  static constexpr size_t Full = SIZE_MAX;
+
   void Init(size_t size) {
     capacity_ = size;
-    ptr_ = 0;
+    head_ = 0;
+    ranges_.clear();
   }
 
+  // Offset of size free bytes, or Full if there isn't room before the oldest held range.
   size_t Allocate(size_t size) {
-    if (ptr_ + size >= capacity_) {
-      ptr_ = size;
-      return 0;
+    EASSERT(size > 0);
+    if (ranges_.empty()) head_ = 0;
+    size_t offset = Full;
+    if (ranges_.empty() || head_ > ranges_.front().offset) {
+      // held ranges lie in [oldest, head_), free space on both sides
+      if (head_ + size <= capacity_) {
+        offset = head_;
+      } else if (ranges_.empty() || size <= ranges_.front().offset) {
+        offset = 0;
+      }
+    } else if (head_ + size <= ranges_.front().offset) {
+      // wrapped, free space between head_ and the oldest range
+      offset = head_;
     }
-    size_t pos = ptr_;
-    ptr_ += size;
-    return pos;
+    if (offset == Full) return Full;
+    head_ = offset + size;
+    ranges_.push_back({.offset = offset, .size = size});
+    return offset;
+  }
+
+  // Trims the range at offset to size bytes. The rest is free right away if the range is the
+  // newest, otherwise once the range is freed.
+  void Shrink(size_t offset, size_t size) {
+    EASSERT(size > 0);
+    auto it = Find(offset);
+    EASSERT(size <= it->size);
+    it->size = size;
+    if (it + 1 == ranges_.end()) head_ = offset + size;
+  }
+
+  void Free(size_t offset) {
+    Find(offset)->freed = true;
+    while (!ranges_.empty() && ranges_.front().freed) ranges_.pop_front();
   }
 
  private:
-  size_t capacity_;
-  size_t ptr_{};
+  struct Range {
+    size_t offset;
+    size_t size;
+    bool freed{};
+  };
+  std::deque<Range>::iterator Find(size_t offset) {
+    auto it = std::ranges::find(ranges_, offset, &Range::offset);
+    EASSERT(it != ranges_.end());
+    return it;
+  }
+
+  size_t capacity_{};
+  size_t head_{};
+  // held in allocation order, freed ones kept until every older one is freed
+  std::deque<Range> ranges_;
 };
 
 template <typename T>
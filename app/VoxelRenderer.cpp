@@ -132,7 +132,7 @@ void VoxelRenderer::Draw(bool draw_imgui) {
                         VK_ACCESS_2_TRANSFER_READ_BIT),
       };
       PipelineBarrier(cmd, 0, buffer_barriers, {});
-      chunk_vert_pool.ExecuteCopy(cmd);
+      chunk_vert_pool.ExecuteCopy(cmd, GetCurrentFrame().deletion_queue);
       {
         VkBufferMemoryBarrier2 buffer_barriers[] = {
             BufferBarrier(chunk_vert_pool.quad_gpu_buf.buffer, VK_QUEUE_FAMILY_IGNORED,
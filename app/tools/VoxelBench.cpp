@@ -0,0 +1,469 @@
+// Headless mesher benchmark. Meshes a fixed corpus of chunks and reports per-chunk timings, so
+// regressions in the meshing hot path show up without a window or GPU. Also times building a lod
+// parent from eight copies of each corpus chunk, and serializing each corpus chunk with the column
+// codec, with and without its entropy stage, against copying the raw grid and mask. Last, edits
+// boxes of voxels in each corpus chunk and patches its mesh with the incremental remesher, timed
+// against a full remesh. Every patched mesh is checked against the full one quad for quad, as is
+// the material plane mesher's output for every corpus chunk.
+//
+// usage: voxel_bench [--iters N] [--kernel scalar|avx2|avx512] [--mesher default|material_planes]
+//                    [--size 32|64]
+//
+// --size 32 meshes 30^3 chunks with 32-bit mask columns instead of 62^3 with 64-bit ones. Compare
+// the ns/voxel column across sizes, a 62^3 chunk holds ~8.8x the voxels.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <tuple>
+
+#include "pch.hpp"
+#include "voxels/Chunk.hpp"
+#include "voxels/ColumnCodec.hpp"
+#include "voxels/Downsample.hpp"
+#include "voxels/Mesher.hpp"
+#include "voxels/Terrain.hpp"
+
+namespace {
+
+constexpr int CorpusSeed = 1337;
+
+template <int Len>
+using BenchGrid = BasicPaddedChunkGrid3D<Len>;
+
+template <int Len>
+struct BenchChunk {
+  std::string_view name;
+  void (*fill)(BenchGrid<Len>&);
+};
+
+template <int Len>
+void FillEmpty(BenchGrid<Len>&) {}
+
+template <int Len>
+void FillFull(BenchGrid<Len>& grid) {
+  grid.FillBox(ivec3{0}, ivec3{Len}, 128);
+}
+
+template <int Len>
+void FillCheckerboard(BenchGrid<Len>& grid) {
+  for (int y = 0; y < Len; y++) {
+    for (int x = 0; x < Len; x++) {
+      for (int z = 0; z < Len; z++) {
+        grid.Set(x, y, z, ((x + y + z) & 1) ? 128 : 0);
+      }
+    }
+  }
+}
+
+template <int Len>
+void FillRandomMaterial(BenchGrid<Len>& grid) {
+  std::mt19937 rng(CorpusSeed);
+  std::uniform_int_distribution<int> material(1, 255);
+  for (int y = 0; y < Len; y++) {
+    for (int x = 0; x < Len; x++) {
+      for (int z = 0; z < Len; z++) {
+        grid.Set(x, y, z, (rng() & 1) ? material(rng) : 0);
+      }
+    }
+  }
+}
+
+// Few enough materials for the material plane mesher to merge each on its own
+template <int Len>
+void FillFewMaterials(BenchGrid<Len>& grid) {
+  std::mt19937 rng(CorpusSeed);
+  std::uniform_int_distribution<int> material(1, MaxMaterialPlanes - 4);
+  for (int y = 0; y < Len; y++) {
+    for (int x = 0; x < Len; x++) {
+      for (int z = 0; z < Len; z++) {
+        grid.Set(x, y, z, (rng() & 1) ? material(rng) * 16 : 0);
+      }
+    }
+  }
+}
+
+template <int Len>
+void FillSphere(BenchGrid<Len>& grid) {
+  gen::FillSphere<Len>(grid, uint8_t{128});
+}
+
+template <int Len>
+void FillTerrain(BenchGrid<Len>& grid) {
+  gen::FBMNoise noise;
+  noise.Init(CorpusSeed, gen::FBMNoise::DefaultFrequency, gen::FBMNoise::DefaultOctaves);
+  HeightMapFloats floats;
+  noise.FillNoise2D(floats, uvec2{0}, uvec2{Len}, 0.25);
+  if constexpr (Len == PCS) {
+    HeightMapData height_map;
+    gen::NoiseToHeights(floats, height_map, {8, PCS - 8});
+    gen::FillChunkColumns(grid, height_map.heights, 0, 1, 128);
+  } else {
+    // Same terrain scaled down: heights span the same fraction of the chunk
+    std::array<int, Len * Len> heights;
+    gen::NoiseToHeights(std::span<float>(floats.data(), heights.size()), heights,
+                        {Len / 8, Len - (Len / 8)});
+    grid.FillColumns(heights, 128);
+  }
+}
+
+template <int Len>
+constexpr std::array<BenchChunk<Len>, 7> Corpus{{
+    {"empty", FillEmpty<Len>},
+    {"full", FillFull<Len>},
+    {"checkerboard", FillCheckerboard<Len>},
+    {"random_material", FillRandomMaterial<Len>},
+    {"few_materials", FillFewMaterials<Len>},
+    {"sphere", FillSphere<Len>},
+    {"fbm_terrain", FillTerrain<Len>},
+}};
+
+struct BenchResult {
+  double mean_ns{};
+  double min_ns{};
+  int quads{};
+  size_t bytes{};
+};
+
+template <int Len>
+using MeshFn = void (*)(std::span<uint8_t>, BasicMeshAlgData<Len>&, MesherOutputData&);
+
+template <int Len>
+BenchResult Run(const BenchGrid<Len>& grid, MeshFn<Len> mesh_fn, int iters) {
+  auto alg_data = std::make_unique<BasicMeshAlgData<Len>>();
+  auto out = std::make_unique<MesherOutputData>();
+  auto chunk = std::make_unique<BenchGrid<Len>>(grid);
+  alg_data->mask = &chunk->mask;
+
+  constexpr int WarmupIters = 3;
+  for (int i = 0; i < WarmupIters; i++) {
+    mesh_fn(chunk->grid.grid, *alg_data, *out);
+  }
+
+  BenchResult res;
+  res.min_ns = std::numeric_limits<double>::max();
+  double tot_ns = 0;
+  for (int i = 0; i < iters; i++) {
+    auto start = std::chrono::steady_clock::now();
+    mesh_fn(chunk->grid.grid, *alg_data, *out);
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    tot_ns += ns;
+    res.min_ns = std::min(res.min_ns, ns);
+  }
+  res.mean_ns = tot_ns / iters;
+  res.quads = out->vertex_cnt;
+  res.bytes = out->vertices.size() * sizeof(MesherOutputData::VertexVec::value_type);
+  return res;
+}
+
+double RunDownsample(const PaddedChunkGrid3D& grid, DownsampleMode mode, int iters) {
+  std::array<const PaddedChunkGrid3D*, 8> children;
+  children.fill(&grid);
+  auto parent = std::make_unique<PaddedChunkGrid3D>();
+  DownsampleChunk(children, mode, *parent);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; i++) {
+    DownsampleChunk(children, mode, *parent);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iters;
+}
+
+struct CodecResult {
+  size_t bytes{};
+  double encode_ns{};
+  double decode_ns{};
+};
+
+// entropy unset is the column codec in byte mode, raw copies the grid and mask as they are.
+CodecResult RunCodec(const PaddedChunkGrid3D& grid, bool raw, bool entropy, int iters) {
+  auto decoded = std::make_unique<PaddedChunkGrid3D>();
+  std::vector<uint8_t> buf;
+  bool decoded_ok = true;
+  auto encode = [&] {
+    if (raw) {
+      buf.resize(sizeof(grid.grid.grid) + sizeof(grid.mask.mask));
+      memcpy(buf.data(), grid.grid.grid.data(), sizeof(grid.grid.grid));
+      memcpy(buf.data() + sizeof(grid.grid.grid), grid.mask.mask.data(), sizeof(grid.mask.mask));
+    } else {
+      EncodeChunkColumns(grid, buf, entropy);
+    }
+  };
+  auto decode = [&] {
+    if (raw) {
+      memcpy(decoded->grid.grid.data(), buf.data(), sizeof(grid.grid.grid));
+      memcpy(decoded->mask.mask.data(), buf.data() + sizeof(grid.grid.grid),
+             sizeof(grid.mask.mask));
+    } else {
+      decoded_ok = DecodeChunkColumns(buf, *decoded);
+    }
+  };
+  auto time_ns = [iters](auto&& f) {
+    f();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iters; i++) f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iters;
+  };
+  CodecResult res;
+  res.encode_ns = time_ns(encode);
+  res.decode_ns = time_ns(decode);
+  res.bytes = buf.size();
+  EASSERT(decoded_ok && decoded->mask.mask == grid.mask.mask);
+  EASSERT(memcmp(decoded->grid.grid.data(), grid.grid.grid.data(), sizeof(grid.grid.grid)) == 0);
+  return res;
+}
+
+// Quads of one face sorted, the incremental remesher and the material plane mesher emit them in a
+// different order.
+std::vector<uint64_t> SortedFaceQuads(const MesherOutputData& mesh, int begin, int cnt) {
+  std::vector<uint64_t> quads(cnt);
+  for (int i = 0; i < cnt; i++) {
+    memcpy(&quads[i], mesh.vertices.data() + (static_cast<size_t>(begin + i) * QuadWordCount),
+           QuadWordCount * sizeof(QuadWord));
+  }
+  std::ranges::sort(quads);
+  return quads;
+}
+
+// Meshes the chunk with both meshers and checks the material plane one produces the same quads per
+// face as GenerateMesh. Returns the chunk's material count, past MaxMaterialPlanes the material
+// plane mesher falls back to GenerateMesh's merge.
+int CheckMaterialPlanes(const PaddedChunkGrid3D& grid) {
+  auto chunk = std::make_unique<PaddedChunkGrid3D>(grid);
+  auto alg_data = std::make_unique<MeshAlgData>();
+  auto planes_alg_data = std::make_unique<MeshAlgData>();
+  alg_data->mask = &chunk->mask;
+  planes_alg_data->mask = &chunk->mask;
+  MesherOutputData mesh;
+  MesherOutputData planes;
+  GenerateMesh(chunk->grid.grid, *alg_data, mesh);
+  GenerateMeshMaterialPlanes(chunk->grid.grid, *planes_alg_data, planes);
+  EASSERT(planes.vertex_cnt == mesh.vertex_cnt);
+  for (int face = 0; face < 6; face++) {
+    const int cnt = alg_data->face_vertex_lengths[face];
+    EASSERT(cnt == planes_alg_data->face_vertex_lengths[face]);
+    EASSERT(SortedFaceQuads(planes, planes_alg_data->face_vertices_start_indices[face], cnt) ==
+            SortedFaceQuads(mesh, alg_data->face_vertices_start_indices[face], cnt));
+  }
+  std::array<bool, 256> used{};
+  for (uint8_t voxel : chunk->grid.grid) used[voxel] = true;
+  return static_cast<int>(std::ranges::count(used.begin() + 1, used.end(), true));
+}
+
+struct RemeshResult {
+  double patch_ns{};
+  double edit_ns{};
+  double full_ns{};
+};
+
+// Fills a box of edit^3 voxels at a random spot per iteration, padding included, alternating
+// between carving and a new material. patch_ns is the remesh alone, edit_ns adds writing the
+// whole mesh out, as an upload does.
+RemeshResult RunRemesh(const PaddedChunkGrid3D& grid, int edit, int iters) {
+  auto chunk = std::make_unique<PaddedChunkGrid3D>(grid);
+  auto alg_data = std::make_unique<MeshAlgData>();
+  auto full_alg_data = std::make_unique<MeshAlgData>();
+  auto mesh = std::make_unique<IncrementalMeshData>();
+  alg_data->mask = &chunk->mask;
+  full_alg_data->mask = &chunk->mask;
+  GenerateMeshIncremental(chunk->grid.grid, *alg_data, *mesh);
+
+  std::mt19937 rng(CorpusSeed);
+  std::uniform_int_distribution<int> corner(0, PCS - edit);
+  std::vector<ivec3> modified;
+  MesherOutputData patched;
+  MesherOutputData full;
+  RemeshResult res;
+  for (int i = 0; i < iters; i++) {
+    const ivec3 min{corner(rng), corner(rng), corner(rng)};
+    chunk->FillBox(min, min + edit, (i & 1) ? 0 : 64);
+    modified.clear();
+    AppendRemeshBox(min, min + edit, modified);
+
+    auto start = std::chrono::steady_clock::now();
+    RemeshVoxels(chunk->grid.grid, *alg_data, modified, *mesh);
+    const auto patch_end = std::chrono::steady_clock::now();
+    CopyIncrementalMesh(*mesh, patched);
+    auto end = std::chrono::steady_clock::now();
+    res.patch_ns += std::chrono::duration<double, std::nano>(patch_end - start).count();
+    res.edit_ns += std::chrono::duration<double, std::nano>(end - start).count();
+    start = std::chrono::steady_clock::now();
+    GenerateMesh(chunk->grid.grid, *full_alg_data, full);
+    end = std::chrono::steady_clock::now();
+    res.full_ns += std::chrono::duration<double, std::nano>(end - start).count();
+
+    EASSERT(patched.vertex_cnt == full.vertex_cnt);
+    for (int face = 0; face < 6; face++) {
+      const int cnt = mesh->face_vertex_lengths[face];
+      EASSERT(cnt == full_alg_data->face_vertex_lengths[face]);
+      EASSERT(SortedFaceQuads(patched, mesh->face_vertices_start_indices[face], cnt) ==
+              SortedFaceQuads(full, full_alg_data->face_vertices_start_indices[face], cnt));
+    }
+  }
+  res.patch_ns /= iters;
+  res.edit_ns /= iters;
+  res.full_ns /= iters;
+  return res;
+}
+
+// Downsampling, the codec, the material plane mesher and incremental remeshing only exist for
+// full-size chunks, so their tables are skipped for other sizes.
+template <int Len>
+void RunCorpus(MeshFn<Len> mesh_fn, int iters) {
+  constexpr double Voxels = ChunkDims<Len>::CS2 * ChunkDims<Len>::CS;
+  fmt::println("{:<18}{:>14}{:>14}{:>10}{:>12}{:>12}", "chunk", "mean ns", "min ns", "quads",
+               "bytes/quad", "ns/voxel");
+  auto grid = std::make_unique<BenchGrid<Len>>();
+  for (const auto& [name, fill] : Corpus<Len>) {
+    grid->Clear();
+    fill(*grid);
+    auto res = Run<Len>(*grid, mesh_fn, iters);
+    double bytes_per_quad = res.quads ? static_cast<double>(res.bytes) / res.quads : 0.0;
+    fmt::println("{:<18}{:>14.0f}{:>14.0f}{:>10}{:>12.2f}{:>12.3f}", name, res.mean_ns,
+                 res.min_ns, res.quads, bytes_per_quad, res.mean_ns / Voxels);
+  }
+
+  if constexpr (Len == PCS) {
+    fmt::println("\n{:<18}{:>14}{:>14}", "downsample", "or ns", "majority ns");
+    for (const auto& [name, fill] : Corpus<Len>) {
+      grid->Clear();
+      fill(*grid);
+      fmt::println("{:<18}{:>14.0f}{:>14.0f}", name,
+                   RunDownsample(*grid, DownsampleMode::Or, iters),
+                   RunDownsample(*grid, DownsampleMode::Majority, iters));
+    }
+
+    // throughput in MB/s of the raw grid and mask, whatever the encoded size
+    constexpr double RawBytes = sizeof(grid->grid.grid) + sizeof(grid->mask.mask);
+    fmt::println("\n{:<18}{:>14}{:>14}{:>10}{:>12}{:>12}", "codec", "format", "bytes", "ratio",
+                 "enc MB/s", "dec MB/s");
+    for (const auto& [name, fill] : Corpus<Len>) {
+      grid->Clear();
+      fill(*grid);
+      for (const auto& [format, raw, entropy] :
+           {std::tuple{"raw", true, false}, {"column", false, false}, {"column+rc", false, true}}) {
+        const auto res = RunCodec(*grid, raw, entropy, iters);
+        fmt::println("{:<18}{:>14}{:>14}{:>10.1f}{:>12.0f}{:>12.0f}", name, format, res.bytes,
+                     RawBytes / static_cast<double>(res.bytes), RawBytes * 1e3 / res.encode_ns,
+                     RawBytes * 1e3 / res.decode_ns);
+      }
+    }
+
+    fmt::println("\n{:<18}{:>14}{:>14}", "material planes", "materials", "merge");
+    for (const auto& [name, fill] : Corpus<Len>) {
+      grid->Clear();
+      fill(*grid);
+      const int materials = CheckMaterialPlanes(*grid);
+      fmt::println("{:<18}{:>14}{:>14}", name, materials,
+                   materials > MaxMaterialPlanes ? "fallback" : "planes");
+    }
+
+    fmt::println("\n{:<18}{:>14}{:>14}{:>14}{:>14}{:>10}", "remesh", "edit voxels", "patch ns",
+                 "edit ns", "full ns", "speedup");
+    for (const auto& [name, fill] : Corpus<Len>) {
+      grid->Clear();
+      fill(*grid);
+      for (int edit : {1, 2, 4, 8}) {
+        const auto res = RunRemesh(*grid, edit, iters);
+        fmt::println("{:<18}{:>14}{:>14.0f}{:>14.0f}{:>14.0f}{:>10.1f}", name, edit * edit * edit,
+                     res.patch_ns, res.edit_ns, res.full_ns, res.full_ns / res.edit_ns);
+      }
+    }
+  }
+}
+
+const char* KernelName(CullKernel kernel) {
+  switch (kernel) {
+    case CullKernel::AVX512:
+      return "avx512";
+    case CullKernel::AVX2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+struct Options {
+  int iters{100};
+  int size{PCS};
+  // the best one the cpu supports unless given
+  CullKernel kernel{GetCullKernel()};
+  std::string_view mesher{"default"};
+};
+
+void PrintUsage() {
+  fmt::println(
+      "usage: voxel_bench [--iters N] [--kernel scalar|avx2|avx512] "
+      "[--mesher default|material_planes] [--size 32|64]");
+}
+
+// Unknown values fail like unknown flags, a run must never measure a configuration it wasn't
+// asked for.
+bool ParseArgs(int argc, char** argv, Options& opts) {
+  auto has = [&](int i) { return i + 1 < argc; };
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--iters" && has(i)) {
+      opts.iters = std::atoi(argv[++i]);
+      if (opts.iters <= 0) return false;
+    } else if (arg == "--kernel" && has(i)) {
+      std::string_view k = argv[++i];
+      if (k == "scalar") {
+        opts.kernel = CullKernel::Scalar;
+      } else if (k == "avx2") {
+        opts.kernel = CullKernel::AVX2;
+      } else if (k == "avx512") {
+        opts.kernel = CullKernel::AVX512;
+      } else {
+        return false;
+      }
+    } else if (arg == "--mesher" && has(i)) {
+      opts.mesher = argv[++i];
+      if (opts.mesher != "default" && opts.mesher != "material_planes") return false;
+    } else if (arg == "--size" && has(i)) {
+      opts.size = std::atoi(argv[++i]);
+      if (opts.size != 32 && opts.size != PCS) return false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!ParseArgs(argc, argv, opts)) {
+    PrintUsage();
+    return 1;
+  }
+  if (opts.mesher == "material_planes" && opts.size != PCS) {
+    fmt::println("material_planes mesher requires --size {}", PCS);
+    return 1;
+  }
+  SetCullKernel(opts.kernel);
+  if (GetCullKernel() != opts.kernel) {
+    fmt::println("{} culling kernel isn't supported by this cpu", KernelName(opts.kernel));
+    return 1;
+  }
+  const int iters = opts.iters;
+  const int size = opts.size;
+  const std::string_view mesher_name = opts.mesher;
+
+  // The SIMD culling kernels only exist for 64-bit columns
+  fmt::println("cull kernel: {}, mesher: {}, size: {}, iters: {}",
+               size == PCS ? KernelName(GetCullKernel()) : "scalar", mesher_name, size, iters);
+  if (size == 32) {
+    RunCorpus<32>(GenerateMesh<32>, iters);
+  } else if (mesher_name == "material_planes") {
+    RunCorpus<PCS>(GenerateMeshMaterialPlanes, iters);
+  } else {
+    RunCorpus<PCS>(GenerateMesh<PCS>, iters);
+  }
+  return 0;
+}
@@ -0,0 +1,301 @@
+// Offline world pre-generation. Generates and meshes every chunk of a box at each lod of a range
+// on all cores and writes them as region files, which the app loads through world.region_dir
+// instead of running the generator. Needs no window or GPU.
+//
+// usage: voxel_pregen --out DIR [--seed N] [--box X0 Y0 Z0 X1 Y1 Z1] [--lods MIN MAX]
+//                     [--threads N] [--terrain columns|layered|density] [--chunks-y N]
+//                     [--freq F] [--mesher default|material_planes] [--entropy] [--force]
+//
+// The box is in lod 0 chunk coordinates and half open. Lod k covers it with chunks 2^k times as
+// large. The app only uses the stored world if its seed and terrain cvars match the ones given
+// here. Running again into a directory made with the same settings adds the box to the world:
+// chunks are appended to the regions that already exist instead of replacing them. A directory
+// holding a world made with other settings is refused, --force deletes its regions first.
+// --entropy range codes the voxels, several times smaller for slower loads.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <string_view>
+#include <thread>
+
+#include "pch.hpp"
+#include "voxels/ColumnCodec.hpp"
+#include "voxels/Mesher.hpp"
+#include "voxels/RegionStore.hpp"
+#include "voxels/WorldGenerator.hpp"
+
+namespace {
+
+struct Options {
+  std::filesystem::path out;
+  WorldGenSettings settings;
+  ivec3 box_min{-4, 0, -4};
+  ivec3 box_max{4, 1, 4};
+  int min_lod{};
+  int max_lod{};
+  int threads{};
+  bool material_planes{true};
+  bool entropy{};
+  bool force{};
+};
+
+// Chunks of one region file, written by whichever worker finishes its last chunk.
+struct RegionJob {
+  ivec3 region;
+  int lod;
+  std::atomic<int> remaining{};
+  std::vector<RegionChunkData> chunks;
+};
+
+struct ChunkJob {
+  RegionJob* region;
+  ivec3 pos;
+};
+
+struct Totals {
+  std::atomic<uint64_t> chunks{};
+  std::atomic<uint64_t> solid_chunks{};
+  std::atomic<uint64_t> quads{};
+  std::atomic<uint64_t> voxel_bytes{};
+  std::atomic<uint64_t> regions{};
+  std::atomic<uint64_t> failed_regions{};
+};
+
+int FloorDiv(int v, int d) { return (v >= 0 ? v : v - d + 1) / d; }
+
+void PrintUsage() {
+  fmt::println(
+      "usage: voxel_pregen --out DIR [--seed N] [--box X0 Y0 Z0 X1 Y1 Z1] [--lods MIN MAX] "
+      "[--threads N] [--terrain columns|layered|density] [--chunks-y N] [--freq F] "
+      "[--mesher default|material_planes] [--entropy] [--force]");
+}
+
+// Unknown values fail like unknown flags, a run must never write a world it wasn't asked for.
+bool ParseArgs(int argc, char** argv, Options& opts) {
+  auto has = [&](int i, int n) { return i + n < argc; };
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    if (arg == "--out" && has(i, 1)) {
+      opts.out = argv[++i];
+    } else if (arg == "--seed" && has(i, 1)) {
+      opts.settings.seed = std::atoi(argv[++i]);
+    } else if (arg == "--box" && has(i, 6)) {
+      for (int a = 0; a < 3; a++) opts.box_min[a] = std::atoi(argv[++i]);
+      for (int a = 0; a < 3; a++) opts.box_max[a] = std::atoi(argv[++i]);
+    } else if (arg == "--lods" && has(i, 2)) {
+      opts.min_lod = std::atoi(argv[++i]);
+      opts.max_lod = std::atoi(argv[++i]);
+    } else if (arg == "--threads" && has(i, 1)) {
+      opts.threads = std::atoi(argv[++i]);
+    } else if (arg == "--terrain" && has(i, 1)) {
+      std::string_view t = argv[++i];
+      opts.settings.density_terrain = t == "density";
+      opts.settings.layered_terrain = t == "layered";
+      if (t != "columns" && t != "density" && t != "layered") return false;
+    } else if (arg == "--chunks-y" && has(i, 1)) {
+      opts.settings.chunks_y = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--freq" && has(i, 1)) {
+      opts.settings.frequency = static_cast<float>(std::atof(argv[++i]));
+    } else if (arg == "--mesher" && has(i, 1)) {
+      std::string_view m = argv[++i];
+      opts.material_planes = m == "material_planes";
+      if (m != "default" && m != "material_planes") return false;
+    } else if (arg == "--entropy") {
+      opts.entropy = true;
+    } else if (arg == "--force") {
+      opts.force = true;
+    } else {
+      return false;
+    }
+  }
+  if (opts.out.empty() || opts.min_lod < 0 || opts.max_lod < opts.min_lod || opts.max_lod > 20) {
+    return false;
+  }
+  for (int a = 0; a < 3; a++) {
+    if (opts.box_max[a] <= opts.box_min[a]) return false;
+  }
+  return true;
+}
+
+// Regions in scan order, each listing its chunks, so workers finish regions roughly in order and
+// only a few are held in memory at once.
+void BuildJobs(const Options& opts, std::vector<std::unique_ptr<RegionJob>>& regions,
+               std::vector<ChunkJob>& jobs) {
+  for (int lod = opts.min_lod; lod <= opts.max_lod; lod++) {
+    const int scale = 1 << lod;
+    const ivec3 lo{FloorDiv(opts.box_min.x, scale), FloorDiv(opts.box_min.y, scale),
+                   FloorDiv(opts.box_min.z, scale)};
+    const ivec3 hi{FloorDiv(opts.box_max.x + scale - 1, scale),
+                   FloorDiv(opts.box_max.y + scale - 1, scale),
+                   FloorDiv(opts.box_max.z + scale - 1, scale)};
+    const ivec3 region_lo = RegionOf(lo);
+    const ivec3 region_hi = RegionOf(hi - 1);
+    ivec3 r;
+    for (r.y = region_lo.y; r.y <= region_hi.y; r.y++) {
+      for (r.x = region_lo.x; r.x <= region_hi.x; r.x++) {
+        for (r.z = region_lo.z; r.z <= region_hi.z; r.z++) {
+          auto region = std::make_unique<RegionJob>();
+          region->region = r;
+          region->lod = lod;
+          const ivec3 start = glm::max(lo, r * RegionLen);
+          const ivec3 end = glm::min(hi, (r + 1) * RegionLen);
+          ivec3 p;
+          for (p.y = start.y; p.y < end.y; p.y++) {
+            for (p.x = start.x; p.x < end.x; p.x++) {
+              for (p.z = start.z; p.z < end.z; p.z++) {
+                jobs.push_back({region.get(), p});
+                region->remaining++;
+              }
+            }
+          }
+          regions.emplace_back(std::move(region));
+        }
+      }
+    }
+  }
+}
+
+// The manifest and region files of a world in dir, manifest first.
+std::vector<std::filesystem::path> WorldFiles(const std::filesystem::path& dir) {
+  std::vector<std::filesystem::path> files;
+  std::error_code ec;
+  if (std::filesystem::exists(RegionManifestPath(dir), ec)) {
+    files.push_back(RegionManifestPath(dir));
+  }
+  for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+    if (entry.path().extension() == ".region") files.push_back(entry.path());
+  }
+  return files;
+}
+
+struct WorkerScratch {
+  PaddedChunkGrid3D grid;
+  MeshAlgData alg_data;
+  MesherOutputData mesh;
+};
+
+// existing is open if the out directory already holds a world with these settings
+void ProcessChunk(const Options& opts, const WorldGenerator& generator, RegionStore& existing,
+                  const ChunkJob& job, WorkerScratch& scratch, Totals& totals) {
+  auto& region = *job.region;
+  auto& grid = scratch.grid;
+  grid.Clear();
+  generator.FillChunk(grid, job.pos, region.lod);
+
+  // air chunks are stored too, so the app knows not to generate them
+  auto& data = region.chunks[RegionChunkIndex(job.pos)];
+  EncodeChunkColumns(grid, data.voxels, opts.entropy);
+  totals.voxel_bytes += data.voxels.size();
+  totals.chunks++;
+  if (grid.mask.AnySolid()) totals.solid_chunks++;
+  // a uniform chunk, air or solid padding included, has no faces
+  if (!grid.UniformMaterial()) {
+    scratch.alg_data.mask = &grid.mask;
+    if (opts.material_planes) {
+      GenerateMeshMaterialPlanes(grid.grid.grid, scratch.alg_data, scratch.mesh);
+    } else {
+      GenerateMesh(grid.grid.grid, scratch.alg_data, scratch.mesh);
+    }
+    data.quads = scratch.mesh.vertices;
+    data.face_vertex_lengths = scratch.alg_data.face_vertex_lengths;
+    totals.quads += scratch.mesh.vertex_cnt;
+  }
+
+  // acq_rel so the writer sees every chunk of the region
+  if (region.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    const auto path = RegionPath(opts.out, region.region, region.lod);
+    const std::span<const RegionChunkData, RegionChunks> chunks{region.chunks};
+    const bool ok = existing.IsOpen() && std::filesystem::exists(path)
+                        ? existing.StoreChunks(region.region, region.lod, chunks)
+                        : WriteRegion(path, chunks);
+    if (ok) {
+      totals.regions++;
+    } else {
+      fmt::println("failed to write {}", path.string());
+      totals.failed_regions++;
+    }
+    region.chunks = {};
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!ParseArgs(argc, argv, opts)) {
+    PrintUsage();
+    return 1;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(opts.out, ec);
+  if (ec) {
+    fmt::println("can't create {}: {}", opts.out.string(), ec.message());
+    return 1;
+  }
+  if (opts.threads <= 0) {
+    opts.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  }
+
+  WorldGenerator generator;
+  generator.Init(opts.settings, size_t{256} << 20);
+  RegionStore existing;
+  if (existing.Open(opts.out, WorldGenerator::Version, generator.SettingsHash(),
+                    opts.settings.seed)) {
+    fmt::println("adding to the world in {}", opts.out.string());
+  } else if (auto stale = WorldFiles(opts.out); !stale.empty()) {
+    // regions outside the box would be kept and load as part of the new world
+    if (!opts.force) {
+      fmt::println("{} holds a world made with other settings, pass --force to replace it",
+                   opts.out.string());
+      return 1;
+    }
+    // manifest first, so an interrupted run leaves a directory the app ignores
+    for (const auto& path : stale) {
+      if (!std::filesystem::remove(path, ec)) {
+        fmt::println("can't remove {}: {}", path.string(), ec.message());
+        return 1;
+      }
+    }
+    fmt::println("removed {} files of the old world in {}", stale.size(), opts.out.string());
+  }
+
+  std::vector<std::unique_ptr<RegionJob>> regions;
+  std::vector<ChunkJob> jobs;
+  BuildJobs(opts, regions, jobs);
+  for (auto& region : regions) region->chunks.resize(RegionChunks);
+  fmt::println("seed {}, lods {}-{}, {} chunks in {} regions, {} threads", opts.settings.seed,
+               opts.min_lod, opts.max_lod, jobs.size(), regions.size(), opts.threads);
+
+  const auto start = std::chrono::steady_clock::now();
+  Totals totals;
+  std::atomic<size_t> next_job{};
+  std::vector<std::thread> workers;
+  workers.reserve(opts.threads);
+  for (int t = 0; t < opts.threads; t++) {
+    workers.emplace_back([&] {
+      auto scratch = std::make_unique<WorkerScratch>();
+      for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+        ProcessChunk(opts, generator, existing, jobs[i], *scratch, totals);
+      }
+    });
+  }
+  for (auto& worker : workers) worker.join();
+  const double secs =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  if (totals.failed_regions || !WriteRegionManifest(opts.out, WorldGenerator::Version,
+                                                    generator.SettingsHash(),
+                                                    opts.settings.seed)) {
+    fmt::println("pre-generation failed, {} regions not written", totals.failed_regions.load());
+    return 1;
+  }
+  fmt::println("{} chunks ({} solid), {} quads, {:.1f} MiB voxels, {} regions in {:.2f} s",
+               totals.chunks.load(), totals.solid_chunks.load(), totals.quads.load(),
+               static_cast<double>(totals.voxel_bytes.load()) / (1 << 20), totals.regions.load(),
+               secs);
+  const double chunk_ms =
+      secs * 1000.0 * opts.threads / static_cast<double>(std::max<size_t>(1, jobs.size()));
+  fmt::println("{:.3f} ms/chunk per thread", chunk_ms);
+  return 0;
+}
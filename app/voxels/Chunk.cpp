@@ -1,9 +1,10 @@
 #include "Chunk.hpp"
 
-bool PaddedChunkGrid3D::ValidateBitmask() const {
-  for (int y = 0; y < PaddedChunkGrid3D::Dims.y; y++) {
-    for (int x = 0; x < PaddedChunkGrid3D::Dims.x; x++) {
-      for (int z = 0; z < PaddedChunkGrid3D::Dims.z; z++) {
+template <int Len>
+bool BasicPaddedChunkGrid3D<Len>::ValidateBitmask() const {
+  for (int y = 0; y < Dims.y; y++) {
+    for (int x = 0; x < Dims.x; x++) {
+      for (int z = 0; z < Dims.z; z++) {
         if ((grid.GetZXY(x, y, z) != 0) != mask.TestZXY(x, y, z)) {
           EASSERT(0);
           return false;
@@ -13,3 +14,217 @@ bool PaddedChunkGrid3D::ValidateBitmask() const {
   }
   return true;
 }
+
+namespace {
+
+// Bits [first, first + len) of a mask column.
+template <int Len>
+MaskColumn<Len> ColumnBits(int first, int len) {
+  using Column = MaskColumn<Len>;
+  if (len <= 0) return 0;
+  const Column run = len == Len ? static_cast<Column>(~Column{0}) : (Column{1} << len) - 1;
+  return static_cast<Column>(run << first);
+}
+
+template <int Len>
+bool BoxInBounds(ivec3 min, ivec3 max) {
+  for (int i = 0; i < 3; i++) {
+    if (min[i] < 0 || max[i] > Len) return false;
+  }
+  return true;
+}
+
+bool BoxEmpty(ivec3 min, ivec3 max) { return min.x >= max.x || min.y >= max.y || min.z >= max.z; }
+
+}  // namespace
+
+template <int Len>
+void BasicPaddedChunkGrid3D<Len>::FillBox(ivec3 min, ivec3 max, uint8_t val) {
+  EASSERT(BoxInBounds<Len>(min, max));
+  if (BoxEmpty(min, max)) return;
+  if (min == ivec3{0} && max == ivec3{Len}) {
+    memset(mask.mask.data(), val ? 0xff : 0, sizeof(mask));
+    memset(grid.grid.data(), val, sizeof(grid.grid));
+    return;
+  }
+  using Column = MaskColumn<Len>;
+  const int z_len = max.z - min.z;
+  const Column z_bits = ColumnBits<Len>(min.z, z_len);
+  const Column set_bits = val ? z_bits : 0;
+  for (int y = min.y; y < max.y; y++) {
+    Column* row = &mask.mask[Len * y];
+    for (int x = min.x; x < max.x; x++) {
+      row[x] = (row[x] & ~z_bits) | set_bits;
+    }
+    for (int x = min.x; x < max.x; x++) {
+      memset(&grid.grid[ZXY<Len>(x, y, min.z)], val, z_len);
+    }
+  }
+}
+
+template <int Len>
+void BasicPaddedChunkGrid3D<Len>::FillColumns(std::span<const int> heights, uint8_t val, int first,
+                                              int last) {
+  EASSERT(first >= 0 && last < Len && heights.size() >= static_cast<size_t>(Len * Len));
+  if (val == 0) return;
+  using Column = MaskColumn<Len>;
+  const int len = last - first + 1;
+  const Column range_bits = ColumnBits<Len>(first, len);
+  for (int x = first; x <= last; x++) {
+    // Bit z of by_layers[n] is set for the columns with n solid layers
+    std::array<Column, Len + 1> by_layers{};
+    int max_layers = 0;
+    for (int z = first; z <= last; z++) {
+      const int layers = std::clamp(heights[(z * Len) + x], 0, last + 1);
+      by_layers[layers] |= Column{1} << z;
+      max_layers = std::max(max_layers, layers);
+    }
+    // Going down, each layer's word gains the columns that reach it
+    Column word = 0;
+    for (int y = max_layers - 1; y >= first; y--) {
+      word |= by_layers[y + 1];
+      mask.mask[(Len * y) + x] |= word;
+      uint8_t* run = &grid.grid[ZXY<Len>(x, y, 0)];
+      if (word == range_bits) {
+        memset(run + first, val, len);
+      } else {
+        for (Column bits = word; bits; bits &= bits - 1) {
+          run[std::countr_zero(bits)] = val;
+        }
+      }
+    }
+  }
+}
+
+template <int Len>
+void BasicPaddedChunkGrid3D<Len>::CopyBox(const BasicPaddedChunkGrid3D& src, ivec3 src_min,
+                                          ivec3 dst_min, ivec3 size) {
+  EASSERT(BoxInBounds<Len>(src_min, src_min + size) && BoxInBounds<Len>(dst_min, dst_min + size));
+  if (BoxEmpty(ivec3{0}, size)) return;
+  using Column = MaskColumn<Len>;
+  const Column z_bits = ColumnBits<Len>(dst_min.z, size.z);
+  for (int y = 0; y < size.y; y++) {
+    const Column* src_row = &src.mask.mask[Len * (src_min.y + y)];
+    Column* dst_row = &mask.mask[Len * (dst_min.y + y)];
+    for (int x = 0; x < size.x; x++) {
+      const Column moved =
+          static_cast<Column>((src_row[src_min.x + x] >> src_min.z) << dst_min.z);
+      Column& dst = dst_row[dst_min.x + x];
+      dst = (dst & ~z_bits) | (moved & z_bits);
+    }
+    for (int x = 0; x < size.x; x++) {
+      memcpy(&grid.grid[ZXY<Len>(dst_min.x + x, dst_min.y + y, dst_min.z)],
+             &src.grid.grid[ZXY<Len>(src_min.x + x, src_min.y + y, src_min.z)], size.z);
+    }
+  }
+}
+
+template <int Len>
+std::optional<uint8_t> BasicPaddedChunkGrid3D<Len>::UniformMaterial(int first, int last) const {
+  EASSERT(first >= 0 && last < Len && first <= last);
+  using Column = MaskColumn<Len>;
+  const int len = last - first + 1;
+  const Column range_bits = ColumnBits<Len>(first, len);
+  const Column expected = mask.mask[(Len * first) + first] & range_bits;
+  if (expected != 0 && expected != range_bits) return std::nullopt;
+  for (int y = first; y <= last; y++) {
+    for (int x = first; x <= last; x++) {
+      if ((mask.mask[(Len * y) + x] & range_bits) != expected) return std::nullopt;
+    }
+  }
+  if (expected == 0) return 0;
+  const uint8_t material = grid.grid[ZXY<Len>(first, first, first)];
+  for (int y = first; y <= last; y++) {
+    for (int x = first; x <= last; x++) {
+      const uint8_t* run = &grid.grid[ZXY<Len>(x, y, first)];
+      if (!std::all_of(run, run + len, [material](uint8_t v) { return v == material; })) {
+        return std::nullopt;
+      }
+    }
+  }
+  return material;
+}
+
+template struct BasicPaddedChunkGrid3D<32>;
+template struct BasicPaddedChunkGrid3D<64>;
+
+namespace {
+
+// Padding layer written and border layer read from the neighbor, along the axis of dir
+int PaddingLayer(int dir) { return (dir & 1) ? PCS - 1 : 0; }
+int BorderLayer(int dir) { return (dir & 1) ? 1 : CS; }
+
+}  // namespace
+
+void CopyNeighborPaddingMask(PaddedChunkMask& mask, const PaddedChunkGrid3D* neighbor, int dir) {
+  const int dst = PaddingLayer(dir);
+  const int src = BorderLayer(dir);
+  constexpr uint64_t InteriorBits = ~(1ull | (1ull << (PCS - 1)));
+  auto& dst_mask = mask.mask;
+  switch (dir >> 1) {
+    case 0:
+      for (int y = 1; y <= CS; y++) {
+        dst_mask[(PCS * y) + dst] =
+            neighbor ? neighbor->mask.mask[(PCS * y) + src] & InteriorBits : 0;
+      }
+      break;
+    case 1:
+      for (int x = 1; x <= CS; x++) {
+        dst_mask[(PCS * dst) + x] =
+            neighbor ? neighbor->mask.mask[(PCS * src) + x] & InteriorBits : 0;
+      }
+      break;
+    default:
+      for (int y = 1; y <= CS; y++) {
+        for (int x = 1; x <= CS; x++) {
+          const int i = (PCS * y) + x;
+          const uint64_t bit = neighbor ? (neighbor->mask.mask[i] >> src) & 1 : 0;
+          dst_mask[i] = (dst_mask[i] & ~(1ull << dst)) | (bit << dst);
+        }
+      }
+      break;
+  }
+}
+
+void CopyNeighborPadding(PaddedChunkGrid3D& grid, const PaddedChunkGrid3D* neighbor, int dir,
+                         std::vector<ivec3>* changed) {
+  CopyNeighborPaddingMask(grid.mask, neighbor, dir);
+  const int dst = PaddingLayer(dir);
+  const int src = BorderLayer(dir);
+  auto& voxels = grid.grid.grid;
+  // Runs of CS voxels along z
+  auto copy_run = [&voxels, neighbor, changed](ivec3 dst_pos, ivec3 src_pos) {
+    uint8_t* dst_run = &voxels[ZXY<PCS>(dst_pos.x, dst_pos.y, dst_pos.z)];
+    const uint8_t* src_run =
+        neighbor ? &neighbor->grid.grid[ZXY<PCS>(src_pos.x, src_pos.y, src_pos.z)] : nullptr;
+    if (changed) {
+      for (int i = 0; i < CS; i++) {
+        const uint8_t v = src_run ? src_run[i] : 0;
+        if (dst_run[i] != v) changed->emplace_back(dst_pos + ivec3{0, 0, i});
+      }
+    }
+    if (src_run) {
+      memcpy(dst_run, src_run, CS);
+    } else {
+      memset(dst_run, 0, CS);
+    }
+  };
+  switch (dir >> 1) {
+    case 0:
+      for (int y = 1; y <= CS; y++) copy_run({dst, y, 1}, {src, y, 1});
+      break;
+    case 1:
+      for (int x = 1; x <= CS; x++) copy_run({x, dst, 1}, {x, src, 1});
+      break;
+    default:
+      for (int y = 1; y <= CS; y++) {
+        for (int x = 1; x <= CS; x++) {
+          const uint8_t v = neighbor ? neighbor->grid.grid[ZXY<PCS>(x, y, src)] : 0;
+          uint8_t& voxel = voxels[ZXY<PCS>(x, y, dst)];
+          if (changed && voxel != v) changed->emplace_back(x, y, dst);
+          voxel = v;
+        }
+      }
+      break;
+  }
+}
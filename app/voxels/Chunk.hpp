@@ -1,12 +1,17 @@
 #pragma once
 
+#include <optional>
+#include <span>
+#include <vector>
+
 #include "voxels/Grid3D.hpp"
 #include "voxels/Mask.hpp"
 
-struct PaddedChunkGrid3D {
-  Grid3D<PCS> grid;
-  PaddedChunkMask mask;
-  static constexpr i8vec3 Dims = i8vec3{PCS};
+template <int Len>
+struct BasicPaddedChunkGrid3D {
+  Grid3D<Len> grid;
+  BasicPaddedChunkMask<Len> mask;
+  static constexpr i8vec3 Dims = i8vec3{Len};
   void Set(int x, int y, int z, uint8_t val) {
     mask.SetZXY(x, y, z, val);
     grid.SetZXY(x, y, z, val);
@@ -15,12 +20,47 @@ struct PaddedChunkGrid3D {
     memset(mask.mask.data(), 0, sizeof(mask));
     memset(grid.grid.data(), 0, sizeof(grid.grid));
   }
+
+  // Region writes on whole mask words and material rows. Boxes are half open, [min, max), in
+  // padded coordinates. A value of 0 clears.
+  void FillBox(ivec3 min, ivec3 max, uint8_t val);
+  void ClearBox(ivec3 min, ivec3 max) { FillBox(min, max, 0); }
+  // Sets voxel (x, y, z) below heights[(z * Len) + x] layers, within [first, last] on every axis.
+  // Voxels above the height are left as they are.
+  void FillColumns(std::span<const int> heights, uint8_t val, int first = 0, int last = Len - 1);
+  // Copies the box of the given size at src_min in src to dst_min, mask and materials both.
+  void CopyBox(const BasicPaddedChunkGrid3D& src, ivec3 src_min, ivec3 dst_min, ivec3 size);
+  // The material of every voxel within [first, last] on every axis if they're all the same, 0 if
+  // they're all air. Mixed air and solid is ruled out from the mask before any material is read.
+  [[nodiscard]] std::optional<uint8_t> UniformMaterial(int first = 0, int last = Len - 1) const;
+
   bool ValidateBitmask() const;
 };
 
+using PaddedChunkGrid3D = BasicPaddedChunkGrid3D<PCS>;
+
 struct Chunk {
   Chunk() = default;
   explicit Chunk(ivec3 pos) : pos(pos) {}
   PaddedChunkGrid3D grid;
   ivec3 pos;
 };
+
+// Face neighbors of a chunk, in the order CopyNeighborPadding addresses padding faces.
+constexpr std::array<ivec3, 6> ChunkNeighborDirs{{
+    {-1, 0, 0},
+    {1, 0, 0},
+    {0, -1, 0},
+    {0, 1, 0},
+    {0, 0, -1},
+    {0, 0, 1},
+}};
+
+// Fills the padding face of grid toward ChunkNeighborDirs[dir] from the border layer of the
+// neighbor chunk on that side, mask and materials both. A null neighbor clears the face to air.
+// Only the CS x CS interior of the face is written, the mesher never reads the padding edges.
+// Padded positions whose voxel the copy changes are appended to changed if it's given.
+void CopyNeighborPadding(PaddedChunkGrid3D& grid, const PaddedChunkGrid3D* neighbor, int dir,
+                         std::vector<ivec3>* changed = nullptr);
+// CopyNeighborPadding for the mask alone.
+void CopyNeighborPaddingMask(PaddedChunkMask& mask, const PaddedChunkGrid3D* neighbor, int dir);
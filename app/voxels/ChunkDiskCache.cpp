@@ -0,0 +1,72 @@
+#include "ChunkDiskCache.hpp"
+
+#include <fstream>
+#include <thread>
+
+#include "fmt/format.h"
+
+void ChunkDiskCache::Open(const std::filesystem::path& root, uint32_t generator_version,
+                          uint64_t settings_hash, int seed) {
+  dir_ = root / fmt::format("v{}_{:016x}_s{}", generator_version, settings_hash, seed);
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  if (ec) {
+    fmt::println("chunk disk cache: can't create {}: {}", dir_.string(), ec.message());
+    dir_.clear();
+  }
+}
+
+void ChunkDiskCache::Close() { dir_.clear(); }
+
+std::filesystem::path ChunkDiskCache::ChunkPath(ivec3 pos, int lod) const {
+  return dir_ / fmt::format("l{}_{}_{}_{}.chunk", lod, pos.x, pos.y, pos.z);
+}
+
+bool ChunkDiskCache::Load(ivec3 pos, int lod, PaddedChunkGrid3D& grid) const {
+  ZoneScoped;
+  if (!IsOpen()) return false;
+  std::ifstream file(ChunkPath(pos, lod), std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    misses_++;
+    return false;
+  }
+  thread_local std::vector<uint8_t> buf;
+  buf.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+  if (!file || !DecodeChunkColumns(buf, grid)) {
+    // corrupt or from an older format, the caller regenerates and overwrites it
+    grid.Clear();
+    misses_++;
+    return false;
+  }
+  hits_++;
+  return true;
+}
+
+void ChunkDiskCache::Store(ivec3 pos, int lod, const PaddedChunkGrid3D& grid) const {
+  ZoneScoped;
+  if (!IsOpen()) return;
+  thread_local std::vector<uint8_t> buf;
+  EncodeChunkColumns(grid, buf);
+  const auto path = ChunkPath(pos, lod);
+  auto tmp_path = path;
+  tmp_path += fmt::format(".tmp{}", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+    if (!file) return;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp_path, ec);
+    return;
+  }
+  stores_++;
+  bytes_written_ += buf.size();
+}
+
+ChunkDiskCache::Stats ChunkDiskCache::GetStats() const {
+  return {.hits = hits_, .misses = misses_, .stores = stores_, .bytes_written = bytes_written_};
+}
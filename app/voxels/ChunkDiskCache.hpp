@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+
+#include "voxels/Chunk.hpp"
+#include "voxels/ColumnCodec.hpp"
+
+// Generated chunks saved to disk, so reloading a world reads files instead of running the
+// generator. Each generator setup gets its own directory named by generator version, settings hash
+// and seed; changing any of them misses instead of loading stale terrain. Files are written to a
+// temporary name and renamed, so a reader never sees a partial chunk. Failures only count as
+// misses, the cache is best effort. Load and Store are safe to call from worker threads between
+// Open and Close.
+class ChunkDiskCache {
+ public:
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t bytes_written;
+  };
+
+  void Open(const std::filesystem::path& root, uint32_t generator_version, uint64_t settings_hash,
+            int seed);
+  void Close();
+  [[nodiscard]] bool IsOpen() const { return !dir_.empty(); }
+  [[nodiscard]] bool Load(ivec3 pos, int lod, PaddedChunkGrid3D& grid) const;
+  void Store(ivec3 pos, int lod, const PaddedChunkGrid3D& grid) const;
+  [[nodiscard]] Stats GetStats() const;
+
+  // FNV-1a over the bytes of each value, for settings_hash.
+  template <typename... Ts>
+  static uint64_t HashSettings(const Ts&... values) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    auto add = [&h](const auto& v) {
+      static_assert(std::is_trivially_copyable_v<std::decay_t<decltype(v)>>);
+      const auto* bytes = reinterpret_cast<const uint8_t*>(&v);
+      for (size_t i = 0; i < sizeof(v); i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+      }
+    };
+    (add(values), ...);
+    return h;
+  }
+
+ private:
+  [[nodiscard]] std::filesystem::path ChunkPath(ivec3 pos, int lod) const;
+  std::filesystem::path dir_;
+  mutable std::atomic<uint64_t> hits_{};
+  mutable std::atomic<uint64_t> misses_{};
+  mutable std::atomic<uint64_t> stores_{};
+  mutable std::atomic<uint64_t> bytes_written_{};
+};
@@ -0,0 +1,375 @@
+#include "ColumnCodec.hpp"
+
+#include <bit>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t ColumnCodecMagic = 0x43435856;  // "VXCC"
+constexpr uint8_t ColumnCodecVersion = 1;
+constexpr uint8_t EntropyFlag = 1;
+// A row's control byte is its run count, or with RepeatBit the number of rows after it equal to
+// the row before, minus one
+constexpr uint8_t RepeatBit = 0x80;
+constexpr int MaxRepeat = RepeatBit;
+
+struct Header {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t flags;
+  uint16_t pad;
+};
+
+struct Run {
+  uint8_t material;
+  uint8_t len;
+};
+
+struct RowRuns {
+  std::array<Run, PCS> runs;
+  int cnt{};
+};
+
+// The row before the first one, so a chunk starting with air starts with a repeat
+constexpr std::array<uint8_t, PCS> AirRow{};
+constexpr RowRuns AirRuns{.runs = {Run{0, PCS}}, .cnt = 1};
+
+uint64_t RunBits(int start, int len) {
+  return len == PCS ? ~0ull : ((1ull << len) - 1) << start;
+}
+
+// Bit i is set where voxel i of the row differs from voxel i - 1, and bit 0 always.
+uint64_t RunStarts(const uint8_t* row) {
+  uint64_t starts = 1;
+  uint64_t prev_byte = row[0];
+  for (int i = 0; i < PCS; i += 8) {
+    uint64_t word;
+    memcpy(&word, row + i, sizeof(word));
+    uint64_t diff = word ^ ((word << 8) | prev_byte);
+    // each byte down to its low bit, then the eight low bits gathered into the top byte
+    diff |= diff >> 4;
+    diff |= diff >> 2;
+    diff |= diff >> 1;
+    diff &= 0x0101010101010101ull;
+    starts |= ((diff * 0x0102040810204080ull) >> 56) << i;
+    prev_byte = word >> 56;
+  }
+  return starts;
+}
+
+void BuildRuns(const uint8_t* row, RowRuns& out) {
+  out.cnt = 0;
+  uint64_t starts = RunStarts(row);
+  while (starts) {
+    const int start = std::countr_zero(starts);
+    starts &= starts - 1;
+    const int end = starts ? std::countr_zero(starts) : PCS;
+    out.runs[out.cnt++] = {row[start], static_cast<uint8_t>(end - start)};
+  }
+}
+
+// Symbols stored as bytes: the control byte, then the material and length of every run but the
+// last, whose length is what's left of the row.
+class ByteWriter {
+ public:
+  explicit ByteWriter(std::vector<uint8_t>& out) : out_(out) {}
+  void Control(uint8_t c) { out_.push_back(c); }
+  void Material(uint8_t material, const Run*) { out_.push_back(material); }
+  void Length(uint8_t len, const Run*) { out_.push_back(len); }
+  void Finish() {}
+
+ private:
+  std::vector<uint8_t>& out_;
+};
+
+class ByteReader {
+ public:
+  explicit ByteReader(std::span<const uint8_t> data) : data_(data) {}
+  uint8_t Control() { return Next(); }
+  uint8_t Material(const Run*) { return Next(); }
+  uint8_t Length(const Run*) { return Next(); }
+  [[nodiscard]] bool Ok() const { return ok_; }
+  [[nodiscard]] bool Finish() const { return ok_ && off_ == data_.size(); }
+
+ private:
+  uint8_t Next() {
+    if (off_ == data_.size()) {
+      ok_ = false;
+      return 0;
+    }
+    return data_[off_++];
+  }
+  std::span<const uint8_t> data_;
+  size_t off_{};
+  bool ok_{true};
+};
+
+// Adaptive probabilities of the range coder, 11 bit, one set per kind of symbol.
+using Prob = uint16_t;
+constexpr int ProbBits = 11;
+constexpr Prob ProbInit = 1 << (ProbBits - 1);
+constexpr int ProbShift = 5;
+constexpr uint32_t RangeTop = 1u << 24;
+constexpr int LengthBits = 6;
+static_assert(PCS == 1 << LengthBits, "lengths 1..PCS are coded as len - 1");
+
+struct Model {
+  Model() {
+    control.fill(ProbInit);
+    material.fill(ProbInit);
+    length.fill(ProbInit);
+  }
+  std::array<Prob, 256> control;
+  std::array<Prob, 256> material;
+  std::array<Prob, 1 << LengthBits> length;
+  Prob same_material{ProbInit};
+  Prob same_length{ProbInit};
+};
+
+// Binary range coder with carry propagation through a cached byte, as in LZMA.
+class RangeWriter {
+ public:
+  explicit RangeWriter(std::vector<uint8_t>& out) : out_(out) {}
+  void Control(uint8_t c) { EncodeTree(model_.control, c, 8); }
+  void Material(uint8_t material, const Run* predicted) {
+    if (predicted) {
+      const bool hit = predicted->material == material;
+      EncodeBit(model_.same_material, hit ? 0 : 1);
+      if (hit) return;
+    }
+    EncodeTree(model_.material, material, 8);
+  }
+  void Length(uint8_t len, const Run* predicted) {
+    if (predicted) {
+      const bool hit = predicted->len == len;
+      EncodeBit(model_.same_length, hit ? 0 : 1);
+      if (hit) return;
+    }
+    EncodeTree(model_.length, len - 1, LengthBits);
+  }
+  void Finish() {
+    for (int i = 0; i < 5; i++) ShiftLow();
+  }
+
+ private:
+  void EncodeBit(Prob& prob, int bit) {
+    const uint32_t bound = (range_ >> ProbBits) * prob;
+    if (bit == 0) {
+      range_ = bound;
+      prob += ((1 << ProbBits) - prob) >> ProbShift;
+    } else {
+      low_ += bound;
+      range_ -= bound;
+      prob -= prob >> ProbShift;
+    }
+    while (range_ < RangeTop) {
+      range_ <<= 8;
+      ShiftLow();
+    }
+  }
+  template <size_t N>
+  void EncodeTree(std::array<Prob, N>& probs, uint32_t v, int bits) {
+    uint32_t node = 1;
+    for (int i = bits - 1; i >= 0; i--) {
+      const int bit = (v >> i) & 1;
+      EncodeBit(probs[node & (N - 1)], bit);
+      node = (node << 1) | bit;
+    }
+  }
+  void ShiftLow() {
+    if (static_cast<uint32_t>(low_) < 0xFF000000u || (low_ >> 32) != 0) {
+      const auto carry = static_cast<uint8_t>(low_ >> 32);
+      uint8_t byte = cache_;
+      do {
+        out_.push_back(static_cast<uint8_t>(byte + carry));
+        byte = 0xFF;
+      } while (--cache_size_ != 0);
+      cache_ = static_cast<uint8_t>(low_ >> 24);
+    }
+    cache_size_++;
+    low_ = (low_ & 0x00FFFFFFull) << 8;
+  }
+
+  std::vector<uint8_t>& out_;
+  Model model_;
+  uint64_t low_{};
+  uint32_t range_{0xFFFFFFFFu};
+  uint8_t cache_{};
+  uint64_t cache_size_{1};
+};
+
+class RangeReader {
+ public:
+  explicit RangeReader(std::span<const uint8_t> data) : data_(data) {
+    for (int i = 0; i < 5; i++) code_ = (code_ << 8) | Next();
+  }
+  uint8_t Control() { return static_cast<uint8_t>(DecodeTree(model_.control, 8)); }
+  uint8_t Material(const Run* predicted) {
+    if (predicted && DecodeBit(model_.same_material) == 0) return predicted->material;
+    return static_cast<uint8_t>(DecodeTree(model_.material, 8));
+  }
+  uint8_t Length(const Run* predicted) {
+    if (predicted && DecodeBit(model_.same_length) == 0) return predicted->len;
+    return static_cast<uint8_t>(DecodeTree(model_.length, LengthBits) + 1);
+  }
+  [[nodiscard]] bool Ok() const { return off_ <= data_.size(); }
+  [[nodiscard]] bool Finish() const { return Ok(); }
+
+ private:
+  uint8_t Next() {
+    // past the end counts as corrupt, see Ok
+    return off_ < data_.size() ? data_[off_++] : (off_++, 0);
+  }
+  int DecodeBit(Prob& prob) {
+    const uint32_t bound = (range_ >> ProbBits) * prob;
+    int bit;
+    if (code_ < bound) {
+      range_ = bound;
+      prob += ((1 << ProbBits) - prob) >> ProbShift;
+      bit = 0;
+    } else {
+      code_ -= bound;
+      range_ -= bound;
+      prob -= prob >> ProbShift;
+      bit = 1;
+    }
+    while (range_ < RangeTop) {
+      range_ <<= 8;
+      code_ = (code_ << 8) | Next();
+    }
+    return bit;
+  }
+  template <size_t N>
+  uint32_t DecodeTree(std::array<Prob, N>& probs, int bits) {
+    uint32_t node = 1;
+    for (int i = 0; i < bits; i++) node = (node << 1) | DecodeBit(probs[node & (N - 1)]);
+    return node - (1u << bits);
+  }
+
+  std::span<const uint8_t> data_;
+  size_t off_{};
+  Model model_;
+  uint32_t range_{0xFFFFFFFFu};
+  uint32_t code_{};
+};
+
+template <typename Writer>
+void EncodeRows(const PaddedChunkGrid3D& grid, Writer& writer) {
+  const auto& voxels = grid.grid.grid;
+  const uint8_t* prev_row = AirRow.data();
+  RowRuns prev = AirRuns;
+  RowRuns curr;
+  int repeat = 0;
+  auto flush_repeat = [&] {
+    if (repeat) writer.Control(static_cast<uint8_t>(RepeatBit | (repeat - 1)));
+    repeat = 0;
+  };
+  for (int r = 0; r < PCS2; r++) {
+    const uint8_t* row = &voxels[r * PCS];
+    if (memcmp(row, prev_row, PCS) == 0) {
+      if (++repeat == MaxRepeat) flush_repeat();
+      continue;
+    }
+    flush_repeat();
+    BuildRuns(row, curr);
+    writer.Control(static_cast<uint8_t>(curr.cnt));
+    for (int i = 0; i < curr.cnt; i++) {
+      const Run* predicted = i < prev.cnt ? &prev.runs[i] : nullptr;
+      writer.Material(curr.runs[i].material, predicted);
+      if (i + 1 < curr.cnt) writer.Length(curr.runs[i].len, predicted);
+    }
+    std::swap(prev, curr);
+    prev_row = row;
+  }
+  flush_repeat();
+  writer.Finish();
+}
+
+template <typename Reader>
+bool DecodeRows(Reader& reader, PaddedChunkGrid3D& grid) {
+  auto& voxels = grid.grid.grid;
+  auto& mask = grid.mask.mask;
+  RowRuns prev = AirRuns;
+  RowRuns curr;
+  // runs are stored as a word, or a whole row from their start when longer, so the buffer holds
+  // two rows
+  alignas(32) std::array<uint8_t, PCS * 2> row_buf;
+  for (int r = 0; r < PCS2;) {
+    const uint8_t control = reader.Control();
+    if (!reader.Ok()) return false;
+    if (control & RepeatBit) {
+      const int n = (control & ~RepeatBit) + 1;
+      if (n > PCS2 - r) return false;
+      for (int i = r; i < r + n; i++) {
+        if (r == 0) {
+          memset(&voxels[i * PCS], 0, PCS);
+          mask[i] = 0;
+        } else {
+          memcpy(&voxels[i * PCS], &voxels[(r - 1) * PCS], PCS);
+          mask[i] = mask[r - 1];
+        }
+      }
+      r += n;
+      continue;
+    }
+    curr.cnt = control;
+    if (curr.cnt == 0 || curr.cnt > PCS) return false;
+    int start = 0;
+    uint64_t bits = 0;
+    for (int i = 0; i < curr.cnt; i++) {
+      const Run* predicted = i < prev.cnt ? &prev.runs[i] : nullptr;
+      const uint8_t material = reader.Material(predicted);
+      const int len = i + 1 < curr.cnt ? reader.Length(predicted) : PCS - start;
+      if (len <= 0 || len > PCS - start) return false;
+      if (len <= 8) {
+        const uint64_t word = material * 0x0101010101010101ull;
+        memcpy(row_buf.data() + start, &word, sizeof(word));
+      } else {
+        memset(row_buf.data() + start, material, PCS);
+      }
+      if (material) bits |= RunBits(start, len);
+      curr.runs[i] = {material, static_cast<uint8_t>(len)};
+      start += len;
+    }
+    if (start != PCS || !reader.Ok()) return false;
+    memcpy(&voxels[r * PCS], row_buf.data(), PCS);
+    mask[r] = bits;
+    std::swap(prev, curr);
+    r++;
+  }
+  return reader.Finish();
+}
+
+}  // namespace
+
+void EncodeChunkColumns(const PaddedChunkGrid3D& grid, std::vector<uint8_t>& out, bool entropy) {
+  ZoneScoped;
+  const Header header{.magic = ColumnCodecMagic,
+                      .version = ColumnCodecVersion,
+                      .flags = entropy ? EntropyFlag : uint8_t{0},
+                      .pad = 0};
+  out.resize(sizeof(header));
+  memcpy(out.data(), &header, sizeof(header));
+  if (entropy) {
+    RangeWriter writer{out};
+    EncodeRows(grid, writer);
+  } else {
+    ByteWriter writer{out};
+    EncodeRows(grid, writer);
+  }
+}
+
+bool DecodeChunkColumns(std::span<const uint8_t> data, PaddedChunkGrid3D& grid) {
+  ZoneScoped;
+  Header header;
+  if (data.size() < sizeof(header)) return false;
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != ColumnCodecMagic || header.version != ColumnCodecVersion) return false;
+  const auto body = data.subspan(sizeof(header));
+  if (header.flags & EntropyFlag) {
+    RangeReader reader{body};
+    return DecodeRows(reader, grid);
+  }
+  ByteReader reader{body};
+  return DecodeRows(reader, grid);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <span>
+
+#include "voxels/Chunk.hpp"
+
+// Chunk serialization built on the grid's column layout. Each row of PCS voxels along z, the
+// voxels behind one mask word, is stored as its runs of equal material with air as material 0,
+// and rows equal to the one before collapse into a repeat count. Terrain rows are one or a few
+// runs, so a chunk takes a few KiB. Decoding writes every run as a fixed size store of a whole
+// row, later runs overwriting the tail, and derives each mask word from the row's runs.
+//
+// With entropy the run symbols go through an adaptive binary range coder instead of being stored
+// as bytes. Every run's material and length are first coded as a hit or miss against the same run
+// of the previous stored row, which neighboring rows of terrain mostly share. About a third the
+// size again, decoding several times slower.
+void EncodeChunkColumns(const PaddedChunkGrid3D& grid, std::vector<uint8_t>& out,
+                        bool entropy = false);
+// Writes every voxel and mask word of grid, no clear needed. Returns false if data is truncated
+// or malformed.
+[[nodiscard]] bool DecodeChunkColumns(std::span<const uint8_t> data, PaddedChunkGrid3D& grid);
@@ -12,6 +12,20 @@ constexpr const int HALFPCS = PCS / 2;
 constexpr const int PCS2 = PCS * PCS;
 constexpr const int PCS3 = PCS2 * PCS;
 
+// Sizes of a chunk with padded length Len, for code templated on the chunk size. The padded length
+// is also the bit width of a mask column, so Len is 32 (30^3 chunks) or 64 (62^3 chunks).
+template <int Len>
+struct ChunkDims {
+  static_assert(Len == 32 || Len == 64, "mask columns are 32 or 64 bits");
+  static constexpr int PCS = Len;
+  static constexpr int PCS2 = Len * Len;
+  static constexpr int CS = Len - 2;
+  static constexpr int CS2 = CS * CS;
+};
+
+template <int Len>
+using MaskColumn = std::conditional_t<Len == 64, uint64_t, uint32_t>;
+
 template <int Len>
 using Grid3Du8 = std::array<uint8_t, static_cast<std::size_t>(Len* Len* Len)>;
 
@@ -0,0 +1,151 @@
+#include "Downsample.hpp"
+
+namespace {
+
+// Parent padding maps to the single padding voxel of the outer child, interior voxel p maps to
+// child voxels 2p - 1 and 2p, counting from 1 in each child.
+struct ChildRange {
+  int child;
+  int lo;
+  int hi;
+};
+
+constexpr ChildRange ParentToChild(int p) {
+  if (p == 0) return {0, 0, 0};
+  if (p == PCS - 1) return {1, PCS - 1, PCS - 1};
+  const int child = (p - 1) / HALFCS;
+  const int lo = (2 * (p - 1)) - (CS * child) + 1;
+  return {child, lo, lo + 1};
+}
+
+constexpr auto ChildRanges = [] {
+  std::array<ChildRange, PCS> ranges{};
+  for (int p = 0; p < PCS; p++) {
+    ranges[p] = ParentToChild(p);
+  }
+  return ranges;
+}();
+
+// Gathers bits 1, 3, ..., 61 into bits 0..30.
+uint64_t CompactOddBits(uint64_t v) {
+  v = (v >> 1) & 0x5555555555555555ull;
+  v = (v | (v >> 1)) & 0x3333333333333333ull;
+  v = (v | (v >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+  v = (v | (v >> 4)) & 0x00FF00FF00FF00FFull;
+  v = (v | (v >> 8)) & 0x0000FFFF0000FFFFull;
+  v = (v | (v >> 16)) & 0x00000000FFFFFFFFull;
+  return v & ((1ull << HALFCS) - 1);
+}
+
+// Reduction of four child columns. Bit 2k - 1 of pairs is the reduced 2x2x2 block of bits
+// 2k - 1 and 2k, bit b of single the reduced 2x2x1 block of bit b alone, used for padding.
+struct ReducedColumn {
+  uint64_t pairs;
+  uint64_t single;
+};
+
+ReducedColumn ReduceColumns(const uint64_t (&w)[4], DownsampleMode mode) {
+  if (mode == DownsampleMode::Or) {
+    const uint64_t any = w[0] | w[1] | w[2] | w[3];
+    return {any | (any >> 1), any};
+  }
+  // per bit count of the four columns as bit planes, count = s0 + 2 * s1 + 4 * s2
+  const uint64_t ab_sum = w[0] ^ w[1];
+  const uint64_t ab_carry = w[0] & w[1];
+  const uint64_t cd_sum = w[2] ^ w[3];
+  const uint64_t cd_carry = w[2] & w[3];
+  const uint64_t s0 = ab_sum ^ cd_sum;
+  const uint64_t c0 = ab_sum & cd_sum;
+  const uint64_t s1 = ab_carry ^ cd_carry ^ c0;
+  const uint64_t s2 = (ab_carry & cd_carry) | (ab_carry & c0) | (cd_carry & c0);
+
+  // add the count of bit b + 1 onto bit b, only bit 2 and the carry out matter for >= 4
+  const uint64_t n0 = s0 >> 1;
+  const uint64_t n1 = s1 >> 1;
+  const uint64_t n2 = s2 >> 1;
+  const uint64_t carry0 = s0 & n0;
+  const uint64_t carry1 = (s1 & n1) | (s1 & carry0) | (n1 & carry0);
+  const uint64_t sum2 = s2 ^ n2 ^ carry1;
+  const uint64_t carry2 = (s2 & n2) | (s2 & carry1) | (n2 & carry1);
+  // a lone padding bit counts twice, so it needs 2 of 4
+  return {sum2 | carry2, s1 | s2};
+}
+
+const uint64_t* ChildColumn(const PaddedChunkMask* child, int x, int y) {
+  static constexpr uint64_t Empty = 0;
+  return child ? &child->mask[(PCS * y) + x] : &Empty;
+}
+
+}  // namespace
+
+void DownsampleMask(std::span<const PaddedChunkMask* const, 8> children, DownsampleMode mode,
+                    PaddedChunkMask& out) {
+  ZoneScoped;
+  for (int py = 0; py < PCS; py++) {
+    const auto [cy, y0, y1] = ChildRanges[py];
+    for (int px = 0; px < PCS; px++) {
+      const auto [cx, x0, x1] = ChildRanges[px];
+      ReducedColumn halves[2];
+      for (int cz = 0; cz < 2; cz++) {
+        const PaddedChunkMask* child = children[cx + (cz * 2) + (cy * 4)];
+        const uint64_t w[4] = {*ChildColumn(child, x0, y0), *ChildColumn(child, x1, y0),
+                               *ChildColumn(child, x0, y1), *ChildColumn(child, x1, y1)};
+        halves[cz] = ReduceColumns(w, mode);
+      }
+      out.mask[(PCS * py) + px] = (CompactOddBits(halves[0].pairs) << 1) |
+                                  (CompactOddBits(halves[1].pairs) << (HALFCS + 1)) |
+                                  (halves[0].single & 1) | (halves[1].single & (1ull << 63));
+    }
+  }
+}
+
+void DownsampleChunk(std::span<const PaddedChunkGrid3D* const, 8> children, DownsampleMode mode,
+                     PaddedChunkGrid3D& out) {
+  ZoneScoped;
+  std::array<const PaddedChunkMask*, 8> masks;
+  for (int i = 0; i < 8; i++) {
+    masks[i] = children[i] ? &children[i]->mask : nullptr;
+  }
+  DownsampleMask(masks, mode, out.mask);
+
+  constexpr uint64_t HalfMask = (1ull << HALFCS) - 1;
+  for (int py = 0; py < PCS; py++) {
+    const auto [cy, y0, y1] = ChildRanges[py];
+    for (int px = 0; px < PCS; px++) {
+      const auto [cx, x0, x1] = ChildRanges[px];
+      const uint64_t bits = out.mask.mask[(PCS * py) + px];
+      uint8_t* dst = out.grid.grid.data() + (px * PCS) + (py * PCS2);
+      memset(dst, 0, PCS);
+      if (!bits) continue;
+      // A solid parent always has a solid child. Samples are taken upper ones first so surfaces
+      // keep their material, until every solid parent voxel of the half has one.
+      for (int cz = 0; cz < 2; cz++) {
+        const PaddedChunkGrid3D* child = children[cx + (cz * 2) + (cy * 4)];
+        if (!child) continue;
+        const int pad = cz * (PCS - 1);
+        const uint64_t need = (bits >> (1 + (cz * HALFCS))) & HalfMask;
+        uint64_t covered = 0;
+        uint8_t* dst_half = dst + 1 + (cz * HALFCS);
+        for (const int y : {y1, y0}) {
+          for (const int x : {x0, x1}) {
+            const uint8_t* src = child->grid.grid.data() + (x * PCS) + (y * PCS2);
+            if (!dst[pad]) dst[pad] = src[pad];
+            if ((need & ~covered) == 0) continue;
+            for (int k = 0; k < HALFCS; k++) {
+              // branchless selects, the samples are noisy
+              const uint8_t lo = src[(2 * k) + 1];
+              const uint8_t hi = src[(2 * k) + 2];
+              const uint8_t type = lo | (hi & -static_cast<uint8_t>(lo == 0));
+              dst_half[k] |= type & -static_cast<uint8_t>(dst_half[k] == 0);
+            }
+            const uint64_t column = child->mask.mask[(PCS * y) + x];
+            covered |= CompactOddBits(column | (column >> 1));
+          }
+        }
+      }
+      for (int pz = 0; pz < PCS; pz++) {
+        dst[pz] = (bits >> pz) & 1 ? dst[pz] : 0;
+      }
+    }
+  }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <span>
+
+#include "voxels/Chunk.hpp"
+
+// Builds a chunk at half resolution from its eight children, so coarse lods can come from
+// already generated fine data instead of regenerating terrain. Children are ordered
+// x + (z * 2) + (y * 4), like octree children; a null child is empty. Each parent column is
+// reduced from 2x2 child columns with bitwise ops, 64 z values at a time.
+enum class DownsampleMode : uint8_t {
+  // solid if any of the 8 child voxels is solid, keeps thin features
+  Or,
+  // solid if at least 4 of the 8 child voxels are solid
+  Majority,
+};
+
+void DownsampleMask(std::span<const PaddedChunkMask* const, 8> children, DownsampleMode mode,
+                    PaddedChunkMask& out);
+
+// Also picks each solid parent voxel's material from its children, preferring the upper ones.
+void DownsampleChunk(std::span<const PaddedChunkGrid3D* const, 8> children, DownsampleMode mode,
+                     PaddedChunkGrid3D& out);
@@ -0,0 +1,97 @@
+#include "HeightMapCache.hpp"
+
+#include <algorithm>
+
+void HeightMapCache::Init(size_t budget_bytes, Generator generator) {
+  generator_ = std::move(generator);
+  shard_capacity_ = std::max<size_t>(1, budget_bytes / sizeof(Slot) / ShardCount);
+  Clear();
+}
+
+HeightMapCache::Shard& HeightMapCache::GetShard(ivec3 key) {
+  // the low bits of glm's hash combine are weak for small coordinates, mix before picking a shard
+  uint64_t h = std::hash<ivec3>{}(key);
+  h *= 0x9E3779B97F4A7C15ull;
+  return shards_[(h >> 32) % ShardCount];
+}
+
+HeightMapCache::Handle HeightMapCache::Get(ivec3 key) {
+  ZoneScoped;
+  auto& shard = GetShard(key);
+  std::shared_ptr<Slot> slot;
+  {
+    std::unique_lock<std::mutex> lock(shard.mtx);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_it);
+      slot = it->second.slot;
+      if (!slot->ready) {
+        ZoneScopedN("wait for producer");
+        waits_++;
+        shard.ready_cv.wait(lock, [&slot] { return slot->ready; });
+      } else {
+        hits_++;
+      }
+      return {slot, &slot->data};
+    }
+    misses_++;
+    slot = std::make_shared<Slot>();
+    shard.lru.push_front(key);
+    shard.entries.emplace(key, Entry{.slot = slot, .lru_it = shard.lru.begin()});
+    EvictOverCapacity(shard);
+  }
+
+  generator_(key, slot->data);
+
+  {
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    slot->ready = true;
+  }
+  shard.ready_cv.notify_all();
+  return {slot, &slot->data};
+}
+
+HeightMapCache::Handle HeightMapCache::Find(ivec3 key) {
+  auto& shard = GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end() || !it->second.slot->ready) return nullptr;
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_it);
+  hits_++;
+  const auto& slot = it->second.slot;
+  return {slot, &slot->data};
+}
+
+void HeightMapCache::EvictOverCapacity(Shard& shard) {
+  // pending entries can't be evicted, their producer and waiters still need them
+  auto it = shard.lru.end();
+  while (shard.entries.size() > shard_capacity_ && it != shard.lru.begin()) {
+    --it;
+    auto entry = shard.entries.find(*it);
+    if (!entry->second.slot->ready) continue;
+    shard.entries.erase(entry);
+    it = shard.lru.erase(it);
+    evictions_++;
+  }
+}
+
+void HeightMapCache::Clear() {
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    shard.entries.clear();
+    shard.lru.clear();
+  }
+}
+
+size_t HeightMapCache::Size() const {
+  size_t size = 0;
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    size += shard.entries.size();
+  }
+  return size;
+}
+
+HeightMapCache::Stats HeightMapCache::GetStats() const {
+  return {.hits = hits_, .misses = misses_, .waits = waits_, .evictions = evictions_};
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+
+#include "voxels/Common.hpp"
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+// Thread safe height map cache shared by the terrain workers. Keys are split over shards with
+// their own lock so workers rarely contend. A miss inserts a pending entry and generates outside
+// the lock; concurrent requests for the same key wait for that one producer instead of generating
+// it again. Each shard keeps an LRU list and evicts the least recently used ready entries once it
+// holds more than its share of the memory budget. Handles keep their height map alive after
+// eviction.
+class HeightMapCache {
+ public:
+  using Handle = std::shared_ptr<const HeightMapData>;
+  using Generator = std::function<void(ivec3 key, HeightMapData& out)>;
+  static constexpr int ShardCount = 16;
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    // requests that found the key pending and waited on its producer
+    uint64_t waits;
+    uint64_t evictions;
+  };
+
+  void Init(size_t budget_bytes, Generator generator);
+  [[nodiscard]] Handle Get(ivec3 key);
+  // Ready entry for key without generating it, nullptr if missing or still pending.
+  [[nodiscard]] Handle Find(ivec3 key);
+  // Drops every entry. Pending generations still finish and wake their waiters.
+  void Clear();
+  [[nodiscard]] size_t Size() const;
+  [[nodiscard]] size_t Capacity() const { return shard_capacity_ * ShardCount; }
+  [[nodiscard]] Stats GetStats() const;
+
+ private:
+  struct Slot {
+    HeightMapData data;
+    // guarded by the shard mutex
+    bool ready{};
+  };
+  struct Entry {
+    std::shared_ptr<Slot> slot;
+    std::list<ivec3>::iterator lru_it;
+  };
+  struct Shard {
+    mutable std::mutex mtx;
+    std::condition_variable ready_cv;
+    std::unordered_map<ivec3, Entry> entries;
+    // most recently used at the front
+    std::list<ivec3> lru;
+  };
+  Shard& GetShard(ivec3 key);
+  void EvictOverCapacity(Shard& shard);
+
+  std::array<Shard, ShardCount> shards_;
+  Generator generator_;
+  size_t shard_capacity_{1};
+  std::atomic<uint64_t> hits_{};
+  std::atomic<uint64_t> misses_{};
+  std::atomic<uint64_t> waits_{};
+  std::atomic<uint64_t> evictions_{};
+};
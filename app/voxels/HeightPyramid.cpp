@@ -0,0 +1,58 @@
+#include "HeightPyramid.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace {
+constexpr int TileBits = 6;
+static_assert((1 << TileBits) == PCS, "tiles are PCS samples wide");
+
+// floors for negative samples too
+int TileOf(int sample) { return sample >> TileBits; }
+}  // namespace
+
+void HeightPyramid::Init(const gen::FBMNoise* noise, Params params, size_t budget_bytes) {
+  noise_ = noise;
+  params_ = params;
+  tiles_.Init(budget_bytes, [this](ivec3 key, HeightMapData& out) { BuildTile(key, out); });
+}
+
+void HeightPyramid::Reset(Params params) {
+  params_ = params;
+  tiles_.Clear();
+}
+
+void HeightPyramid::GetHeightMap(ivec2 sample_start, int level, HeightMapData& out) {
+  ZoneScoped;
+  out.range = {INT_MAX, INT_MIN};
+  // a window of PCS samples overlaps at most two tiles per axis
+  for (int tz = TileOf(sample_start.y); tz <= TileOf(sample_start.y + PCS - 1); tz++) {
+    for (int tx = TileOf(sample_start.x); tx <= TileOf(sample_start.x + PCS - 1); tx++) {
+      auto tile = tiles_.Get({tx, tz, level});
+      // overlap of the tile with the window, in window samples
+      const ivec2 tile_start = ivec2{tx, tz} * PCS - sample_start;
+      const int x0 = std::max(tile_start.x, 0);
+      const int x1 = std::min(tile_start.x + PCS, PCS);
+      const int z0 = std::max(tile_start.y, 0);
+      const int z1 = std::min(tile_start.y + PCS, PCS);
+      for (int z = z0; z < z1; z++) {
+        const int* src = &tile->heights[((z - tile_start.y) * PCS) + x0 - tile_start.x];
+        int* dst = &out.heights[(z * PCS) + x0];
+        for (int x = 0; x < x1 - x0; x++) {
+          dst[x] = src[x];
+          out.range.x = std::min(out.range.x, src[x]);
+          out.range.y = std::max(out.range.y, src[x]);
+        }
+      }
+    }
+  }
+}
+
+void HeightPyramid::BuildTile(ivec3 key, HeightMapData& out) {
+  ZoneScoped;
+  HeightMapFloats floats;
+  const float sample_frequency = params_.frequency * std::ldexp(1.f, key.z);
+  noise_->FillNoise2DBandLimited(floats, ivec2{key.x, key.y} * PCS, uvec2{PCS}, sample_frequency);
+  gen::NoiseToHeights(floats, out, {0, params_.max_height});
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "voxels/HeightMapCache.hpp"
+#include "voxels/Terrain.hpp"
+
+// Height maps for the octree lods, served from a pyramid of PCS x PCS height tiles. Level k has
+// samples 2^k world units apart and tile (tx, tz) of level k starts at sample (tx, tz) * PCS. Every
+// tile is generated with only the noise octaves below the Nyquist limit of its sample spacing, so
+// coarse levels run a fraction of the octaves. Tiles are never derived from cached finer ones, so a
+// tile's heights don't depend on what else is cached and neighbouring tiles always line up.
+class HeightPyramid {
+ public:
+  struct Params {
+    // noise frequency per world unit
+    float frequency;
+    int max_height;
+  };
+
+  void Init(const gen::FBMNoise* noise, Params params, size_t budget_bytes);
+  // Drops every tile, call after changing the noise or params.
+  void Reset(Params params);
+  // Height map of the PCS x PCS samples at level starting at sample_start, in level samples.
+  void GetHeightMap(ivec2 sample_start, int level, HeightMapData& out);
+
+  [[nodiscard]] const HeightMapCache& Tiles() const { return tiles_; }
+
+ private:
+  // key is (tx, tz, level)
+  void BuildTile(ivec3 key, HeightMapData& out);
+
+  HeightMapCache tiles_;
+  const gen::FBMNoise* noise_{};
+  Params params_{};
+};
@@ -5,33 +5,36 @@
 
 #include "voxels/Common.hpp"
 
-struct PaddedChunkMask {
-  std::array<uint64_t, PCS2> mask;
-  void SetZXY(int x, int y, int z) { mask[(PCS * y) + x] |= 1ull << (z); }
+template <int Len>
+struct BasicPaddedChunkMask {
+  using Column = MaskColumn<Len>;
+  static constexpr int PCS = ChunkDims<Len>::PCS;
+  std::array<Column, ChunkDims<Len>::PCS2> mask;
+  void SetZXY(int x, int y, int z) { mask[(PCS * y) + x] |= Column{1} << (z); }
   void SetZXY(int x, int y, int z, bool v) {
-    uint64_t bitmask = 1ull << z;
-    mask[(PCS * y) + x] ^= (-static_cast<int64_t>(v) ^ mask[(PCS * y) + x]) & bitmask;
+    Column bitmask = Column{1} << z;
+    mask[(PCS * y) + x] ^= (-static_cast<Column>(v) ^ mask[(PCS * y) + x]) & bitmask;
   }
 
-  void SetXZY(int x, int y, int z) { mask[(PCS * y) + z] |= 1ull << (x); }
+  void SetXZY(int x, int y, int z) { mask[(PCS * y) + z] |= Column{1} << (x); }
   void SetXZY(int x, int y, int z, bool v) {
-    uint64_t bitmask = 1ull << x;
-    mask[(PCS * y) + z] ^= (-static_cast<int64_t>(v) ^ mask[(PCS * y) + z]) & bitmask;
+    Column bitmask = Column{1} << x;
+    mask[(PCS * y) + z] ^= (-static_cast<Column>(v) ^ mask[(PCS * y) + z]) & bitmask;
   }
   [[nodiscard]] bool AnySolid() const {
-    return std::ranges::any_of(mask, [](uint64_t e) { return e != 0; });
+    return std::ranges::any_of(mask, [](Column e) { return e != 0; });
   }
   [[nodiscard]] bool AllSet() const {
-    return std::ranges::all_of(mask, [](uint64_t e) { return e == UINT64_MAX; });
+    return std::ranges::all_of(mask, [](Column e) { return e == static_cast<Column>(~Column{0}); });
   }
-  void ClearXZY(int x, int y, int z) { mask[(PCS * y) + z] &= ~(1ull << (x)); }
-  void ClearZXY(int x, int y, int z) { mask[(PCS * y) + x] &= ~(1ull << (z)); }
+  void ClearXZY(int x, int y, int z) { mask[(PCS * y) + z] &= ~(Column{1} << (x)); }
+  void ClearZXY(int x, int y, int z) { mask[(PCS * y) + x] &= ~(Column{1} << (z)); }
 
   [[nodiscard]] bool TestZXY(int x, int y, int z) const {
-    return (mask[(PCS * y) + x] & (1ull << z)) != 0;
+    return (mask[(PCS * y) + x] & (Column{1} << z)) != 0;
   }
   [[nodiscard]] bool TestXZY(int x, int y, int z) const {
-    return (mask[(PCS * y) + z] & (1ull << x)) != 0;
+    return (mask[(PCS * y) + z] & (Column{1} << x)) != 0;
   }
 
   size_t SolidCount() {
@@ -42,3 +45,5 @@ struct PaddedChunkMask {
     return s;
   }
 };
+
+using PaddedChunkMask = BasicPaddedChunkMask<PCS>;
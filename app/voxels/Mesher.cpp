@@ -1,15 +1,20 @@
 #include "Mesher.hpp"
 
+#include <numeric>
+
+#include "CpuFeatures.hpp"
 #include "application/Timer.hpp"
 
 // https://github.com/cgerikj/binary-greedy-meshing/tree/master
 
 namespace {
 
+template <int Len = PCS>
 inline int AxisIndex(const int axis, const int a, const int b, const int c) {
-  if (axis == 0) return b + (a * PCS) + (c * PCS2);
-  if (axis == 1) return b + (c * PCS) + (a * PCS2);
-  return c + (a * PCS) + (b * PCS2);
+  using D = ChunkDims<Len>;
+  if (axis == 0) return b + (a * D::PCS) + (c * D::PCS2);
+  if (axis == 1) return b + (c * D::PCS) + (a * D::PCS2);
+  return c + (a * D::PCS) + (b * D::PCS2);
 }
 
 #ifdef PACK_QUAD
@@ -24,224 +29,785 @@ inline void EncodeQuad(Quad& q, const uint64_t x, const uint64_t y, const uint64
   q.data[3] = static_cast<uint8_t>(w >> 6 | (h));
   q.data[4] = static_cast<uint8_t>(type);
 }
-inline void InsertQuad(std::vector<uint8_t>& vertices, Quad& quad, int& i_vertex) {
-  if (vertices.size() >= vertices.capacity() - 5) {
-    vertices.reserve(vertices.size() * 2);
-  }
-  vertices.emplace_back(quad.data[0]);
-  vertices.emplace_back(quad.data[1]);
-  vertices.emplace_back(quad.data[2]);
-  vertices.emplace_back(quad.data[3]);
-  vertices.emplace_back(quad.data[4]);
+inline void InsertQuad(QuadWord* vertices, const Quad& quad, int& i_vertex) {
+  memcpy(vertices + (static_cast<size_t>(i_vertex) * QuadWordCount), quad.data, sizeof(quad.data));
   i_vertex++;
 }
+inline void AppendQuad(std::vector<QuadWord>& vertices, const Quad& quad) {
+  vertices.insert(vertices.end(), quad.data, quad.data + QuadWordCount);
+}
 #else
 inline uint64_t EncodeQuad(const uint64_t x, const uint64_t y, const uint64_t z, const uint64_t w,
                            const uint64_t h, const uint64_t type) {
   return (type << 32) | (h << 24) | (w << 18) | (z << 12) | (y << 6) | (x);
 }
-inline void InsertQuad(std::vector<uint64_t>& vertices, uint64_t quad, int& i_vertex) {
-  vertices.emplace_back(quad);
+inline void InsertQuad(QuadWord* vertices, uint64_t quad, int& i_vertex) {
+  vertices[i_vertex] = quad;
   i_vertex++;
 }
+inline void AppendQuad(std::vector<QuadWord>& vertices, uint64_t quad) {
+  vertices.emplace_back(quad);
+}
 #endif
 
-constexpr uint64_t PMask = ~(1ull << 63 | 1);
-}  // namespace
+// Interior bits of a mask column, without the z padding.
+template <int Len>
+constexpr MaskColumn<Len> PMask = ~(MaskColumn<Len>{1} << (Len - 1) | 1);
+
+// Hidden face culling. Writes the six CS2 face planes: faces 0/1 are +y/-y, 2/3 are +x/-x, 4/5
+// are +z/-z. Faces 0-3 are shifted down one bit so bit 0 is the first interior voxel. Also counts
+// the visible faces of each plane while the masks are in registers; each face becomes at most one
+// quad, so the sum bounds the mesh size.
+using CullFacesFn = void (*)(const uint64_t* opaque_mask, uint64_t* face_masks,
+                             uint32_t* face_counts);
+
+// Culls one column and returns its face masks in face order, faces 2/3 are stored transposed.
+template <int Len = PCS>
+inline std::array<MaskColumn<Len>, 6> CullColumnMasks(const MaskColumn<Len>* opaque_mask, int a,
+                                                      int b) {
+  using D = ChunkDims<Len>;
+  const int a_pcs = a * D::PCS;
+  const MaskColumn<Len> column_bits = opaque_mask[a_pcs + b] & PMask<Len>;
+  return {
+      static_cast<MaskColumn<Len>>((column_bits & ~opaque_mask[a_pcs + D::PCS + b]) >> 1),
+      static_cast<MaskColumn<Len>>((column_bits & ~opaque_mask[a_pcs - D::PCS + b]) >> 1),
+      static_cast<MaskColumn<Len>>((column_bits & ~opaque_mask[a_pcs + (b + 1)]) >> 1),
+      static_cast<MaskColumn<Len>>((column_bits & ~opaque_mask[a_pcs + (b - 1)]) >> 1),
+      static_cast<MaskColumn<Len>>(column_bits & ~(opaque_mask[a_pcs + b] >> 1)),
+      static_cast<MaskColumn<Len>>(column_bits & ~(opaque_mask[a_pcs + b] << 1)),
+  };
+}
 
-void GenerateMesh(std::span<uint8_t> voxels, MeshAlgData& alg_data, MesherOutputData& mesh_data) {
-  ZoneScoped;
-  Timer t;
-  mesh_data.vertex_cnt = 0;
-  mesh_data.vertices.clear();
-  const auto& opaque_mask = alg_data.mask->mask;
-  auto& forward_merged = alg_data.forward_merged;
-  auto& right_merged = alg_data.right_merged;
-  int i_vertex{0};
-  auto& face_masks = alg_data.face_masks;
-  // Hidden face culling
+template <int Len = PCS>
+inline void CullColumn(const MaskColumn<Len>* opaque_mask, MaskColumn<Len>* face_masks, int a,
+                       int b) {
+  using D = ChunkDims<Len>;
+  const auto masks = CullColumnMasks<Len>(opaque_mask, a, b);
+  const int ba_index = (b - 1) + ((a - 1) * D::CS);
+  const int ab_index = (a - 1) + ((b - 1) * D::CS);
+  for (int face = 0; face < 6; face++) {
+    const int i = (face == 2 || face == 3) ? ab_index : ba_index;
+    face_masks[i + (face * D::CS2)] = masks[face];
+  }
+}
+
+template <int Len = PCS>
+inline void CullColumnCounted(const MaskColumn<Len>* opaque_mask, MaskColumn<Len>* face_masks,
+                              uint32_t* face_counts, int a, int b) {
+  using D = ChunkDims<Len>;
+  const auto masks = CullColumnMasks<Len>(opaque_mask, a, b);
+  const int ba_index = (b - 1) + ((a - 1) * D::CS);
+  const int ab_index = (a - 1) + ((b - 1) * D::CS);
+  for (int face = 0; face < 6; face++) {
+    const int i = (face == 2 || face == 3) ? ab_index : ba_index;
+    face_masks[i + (face * D::CS2)] = masks[face];
+    face_counts[face] += std::popcount(masks[face]);
+  }
+}
+
+template <int Len = PCS>
+void CullFacesScalar(const MaskColumn<Len>* opaque_mask, MaskColumn<Len>* face_masks,
+                     uint32_t* face_counts) {
+  std::fill_n(face_counts, 6, 0);
+  for (int a = 1; a < Len - 1; a++) {
+    for (int b = 1; b < Len - 1; b++) {
+      CullColumnCounted<Len>(opaque_mask, face_masks, face_counts, a, b);
+    }
+  }
+}
+
+#ifdef CPU_X86_64
+// Per lane bit counts, via a nibble lookup table since AVX2 has no vector popcount. Summed into
+// the 64-bit lanes of acc.
+TARGET_AVX2 inline __m256i AddPopcountAVX2(__m256i acc, __m256i v) {
+  const __m256i lut = _mm256_broadcastsi128_si256(
+      _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+  const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+  const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low_nibble));
+  const __m256i hi =
+      _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+  return _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+}
+
+TARGET_AVX2 inline uint32_t ReduceAddAVX2(__m256i v) {
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// 4 columns per instruction. Faces 2/3 are stored transposed, so those lanes are written out one
+// at a time.
+TARGET_AVX2 void CullFacesAVX2(const uint64_t* opaque_mask, uint64_t* face_masks,
+                               uint32_t* face_counts) {
+  const __m256i p_mask = _mm256_set1_epi64x(static_cast<int64_t>(PMask<PCS>));
+  alignas(32) uint64_t right[4];
+  alignas(32) uint64_t left[4];
+  __m256i counts[6];
+  std::fill_n(counts, 6, _mm256_setzero_si256());
+  std::array<uint32_t, 6> tail_counts{};
   for (int a = 1; a < PCS - 1; a++) {
-    const int a_pcs = a * PCS;
+    const uint64_t* row = opaque_mask + (a * PCS);
+    int b = 1;
+    for (; b + 4 <= PCS - 1; b += 4) {
+      const __m256i center = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + b));
+      const __m256i column_bits = _mm256_and_si256(center, p_mask);
+      const __m256i up = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + PCS + b));
+      const __m256i down = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row - PCS + b));
+      const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + b + 1));
+      const __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + b - 1));
+
+      const __m256i faces[6] = {
+          _mm256_srli_epi64(_mm256_andnot_si256(up, column_bits), 1),
+          _mm256_srli_epi64(_mm256_andnot_si256(down, column_bits), 1),
+          _mm256_srli_epi64(_mm256_andnot_si256(next, column_bits), 1),
+          _mm256_srli_epi64(_mm256_andnot_si256(prev, column_bits), 1),
+          _mm256_andnot_si256(_mm256_srli_epi64(center, 1), column_bits),
+          _mm256_andnot_si256(_mm256_slli_epi64(center, 1), column_bits),
+      };
+      for (int face = 0; face < 6; face++) {
+        counts[face] = AddPopcountAVX2(counts[face], faces[face]);
+      }
 
-    for (int b = 1; b < PCS - 1; b++) {
-      const uint64_t column_bits = opaque_mask[(a * PCS) + b] & PMask;
       const int ba_index = (b - 1) + ((a - 1) * CS);
-      const int ab_index = (a - 1) + ((b - 1) * CS);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(face_masks + ba_index + (0 * CS2)), faces[0]);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(face_masks + ba_index + (1 * CS2)), faces[1]);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(face_masks + ba_index + (4 * CS2)), faces[4]);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(face_masks + ba_index + (5 * CS2)), faces[5]);
+
+      _mm256_store_si256(reinterpret_cast<__m256i*>(right), faces[2]);
+      _mm256_store_si256(reinterpret_cast<__m256i*>(left), faces[3]);
+      for (int i = 0; i < 4; i++) {
+        const int ab_index = (a - 1) + ((b - 1 + i) * CS);
+        face_masks[ab_index + (2 * CS2)] = right[i];
+        face_masks[ab_index + (3 * CS2)] = left[i];
+      }
+    }
+    for (; b < PCS - 1; b++) {
+      CullColumnCounted(opaque_mask, face_masks, tail_counts.data(), a, b);
+    }
+  }
+  for (int face = 0; face < 6; face++) {
+    face_counts[face] = ReduceAddAVX2(counts[face]) + tail_counts[face];
+  }
+}
 
-      face_masks[ba_index + (0 * CS2)] = (column_bits & ~opaque_mask[a_pcs + PCS + b]) >> 1;
-      face_masks[ba_index + (1 * CS2)] = (column_bits & ~opaque_mask[a_pcs - PCS + b]) >> 1;
+// 8 columns per instruction, the last partial group of each row is masked. Faces 2/3 are
+// scattered.
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12 flags _mm512_undefined_epi32 inside its own intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+// AVX512BW version of AddPopcountAVX2, VPOPCNTQ needs the separate VPOPCNTDQ extension.
+TARGET_AVX512 inline __m512i AddPopcountAVX512(__m512i acc, __m512i v) {
+  const __m512i lut = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+  const __m512i low_nibble = _mm512_set1_epi8(0x0f);
+  const __m512i lo = _mm512_shuffle_epi8(lut, _mm512_and_si512(v, low_nibble));
+  const __m512i hi =
+      _mm512_shuffle_epi8(lut, _mm512_and_si512(_mm512_srli_epi16(v, 4), low_nibble));
+  return _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_add_epi8(lo, hi), _mm512_setzero_si512()));
+}
 
-      face_masks[ab_index + (2 * CS2)] = (column_bits & ~opaque_mask[a_pcs + (b + 1)]) >> 1;
-      face_masks[ab_index + (3 * CS2)] = (column_bits & ~opaque_mask[a_pcs + (b - 1)]) >> 1;
+TARGET_AVX512 void CullFacesAVX512(const uint64_t* opaque_mask, uint64_t* face_masks,
+                                   uint32_t* face_counts) {
+  const __m512i p_mask = _mm512_set1_epi64(static_cast<int64_t>(PMask<PCS>));
+  const __m512i lane_offsets =
+      _mm512_setr_epi64(0, CS, 2 * CS, 3 * CS, 4 * CS, 5 * CS, 6 * CS, 7 * CS);
+  __m512i counts[6];
+  std::fill_n(counts, 6, _mm512_setzero_si512());
+  for (int a = 1; a < PCS - 1; a++) {
+    const uint64_t* row = opaque_mask + (a * PCS);
+    for (int b = 1; b < PCS - 1; b += 8) {
+      const int lanes = std::min(8, PCS - 1 - b);
+      const __mmask8 k = static_cast<__mmask8>((1u << lanes) - 1);
+      const __m512i center = _mm512_maskz_loadu_epi64(k, row + b);
+      const __m512i column_bits = _mm512_and_si512(center, p_mask);
+      const __m512i up = _mm512_maskz_loadu_epi64(k, row + PCS + b);
+      const __m512i down = _mm512_maskz_loadu_epi64(k, row - PCS + b);
+      const __m512i next = _mm512_maskz_loadu_epi64(k, row + b + 1);
+      const __m512i prev = _mm512_maskz_loadu_epi64(k, row + b - 1);
+
+      // Masked off lanes loaded zero, so they add nothing to the counts
+      const __m512i faces[6] = {
+          _mm512_srli_epi64(_mm512_andnot_si512(up, column_bits), 1),
+          _mm512_srli_epi64(_mm512_andnot_si512(down, column_bits), 1),
+          _mm512_srli_epi64(_mm512_andnot_si512(next, column_bits), 1),
+          _mm512_srli_epi64(_mm512_andnot_si512(prev, column_bits), 1),
+          _mm512_andnot_si512(_mm512_srli_epi64(center, 1), column_bits),
+          _mm512_andnot_si512(_mm512_slli_epi64(center, 1), column_bits),
+      };
+      for (int face = 0; face < 6; face++) {
+        counts[face] = AddPopcountAVX512(counts[face], faces[face]);
+      }
 
-      face_masks[ba_index + (4 * CS2)] = column_bits & ~(opaque_mask[a_pcs + b] >> 1);
-      face_masks[ba_index + (5 * CS2)] = column_bits & ~(opaque_mask[a_pcs + b] << 1);
+      const int ba_index = (b - 1) + ((a - 1) * CS);
+      _mm512_mask_storeu_epi64(face_masks + ba_index + (0 * CS2), k, faces[0]);
+      _mm512_mask_storeu_epi64(face_masks + ba_index + (1 * CS2), k, faces[1]);
+      _mm512_mask_storeu_epi64(face_masks + ba_index + (4 * CS2), k, faces[4]);
+      _mm512_mask_storeu_epi64(face_masks + ba_index + (5 * CS2), k, faces[5]);
+
+      const __m512i ab_index =
+          _mm512_add_epi64(lane_offsets, _mm512_set1_epi64((a - 1) + ((b - 1) * CS)));
+      _mm512_mask_i64scatter_epi64(face_masks + (2 * CS2), k, ab_index, faces[2], 8);
+      _mm512_mask_i64scatter_epi64(face_masks + (3 * CS2), k, ab_index, faces[3], 8);
     }
   }
+  for (int face = 0; face < 6; face++) {
+    face_counts[face] = _mm512_reduce_add_epi64(counts[face]);
+  }
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+CullFacesFn GetCullFacesFn(CullKernel kernel) {
+#ifdef CPU_X86_64
+  if (kernel == CullKernel::AVX512 && cpu::HasAVX512()) return CullFacesAVX512;
+  if (kernel != CullKernel::Scalar && cpu::HasAVX2()) return CullFacesAVX2;
+#endif
+  return CullFacesScalar<PCS>;
+}
+
+CullKernel BestCullKernel() {
+  if (cpu::HasAVX512()) return CullKernel::AVX512;
+  if (cpu::HasAVX2()) return CullKernel::AVX2;
+  return CullKernel::Scalar;
+}
 
-  // Greedy meshing faces 0-3
-  for (int face = 0; face < 4; face++) {
-    const int axis = face / 2;
+// Upper bound on the quad count of a mesh, from the counts written by culling.
+inline uint32_t MaxQuads(const std::array<uint32_t, 6>& face_counts) {
+  return std::accumulate(face_counts.begin(), face_counts.end(), 0u);
+}
 
-    const int face_vertex_begin = i_vertex;
+CullKernel cull_kernel = BestCullKernel();
+CullFacesFn cull_faces = GetCullFacesFn(cull_kernel);
 
-    for (int layer = 0; layer < CS; layer++) {
-      const int bits_location = (layer * CS) + (face * CS2);
+// Writes into a vector, for callers that keep the mesh on the CPU.
+class VectorMeshSink final : public MeshSink {
+ public:
+  explicit VectorMeshSink(MesherOutputData& mesh_data) : mesh_data_(mesh_data) {}
+  QuadWord* Reserve(uint32_t max_quads) override {
+    mesh_data_.vertices.resize(static_cast<size_t>(max_quads) * QuadWordCount);
+    return mesh_data_.vertices.data();
+  }
+  void Commit(uint32_t quad_cnt) override {
+    mesh_data_.vertices.resize(static_cast<size_t>(quad_cnt) * QuadWordCount);
+    mesh_data_.vertex_cnt = quad_cnt;
+  }
+
+ private:
+  MesherOutputData& mesh_data_;
+};
+
+// Greedy merging of one layer of a face 0-3 plane. Quads never span layers. type_at(axis, a, b, c)
+// returns the material at a padded grid position; a constant type_at turns every type comparison
+// into a no-op. emit(layer, quad) receives each quad.
+template <int Len, typename TypeAt, typename Emit>
+void GreedyLayer03(int face, int layer, const MaskColumn<Len>* face_bits,
+                   BasicMeshAlgData<Len>& alg_data, TypeAt&& type_at, Emit&& emit) {
+  constexpr int CS = ChunkDims<Len>::CS;
+  const int axis = face / 2;
+  auto& forward_merged = alg_data.forward_merged;
+  const int bits_location = layer * CS;
 
-      for (int forward = 0; forward < CS; forward++) {
-        uint64_t bits_here = face_masks[forward + bits_location];
-        if (bits_here == 0) continue;
+  for (int forward = 0; forward < CS; forward++) {
+    uint64_t bits_here = face_bits[forward + bits_location];
+    if (bits_here == 0) continue;
 
-        const uint64_t bits_next = forward + 1 < CS ? face_masks[(forward + 1) + bits_location] : 0;
+    const uint64_t bits_next = forward + 1 < CS ? face_bits[(forward + 1) + bits_location] : 0;
 
-        uint8_t right_merged = 1;
-        while (bits_here) {
-          uint64_t bit_pos;
+    uint8_t right_merged = 1;
+    while (bits_here) {
+      uint64_t bit_pos;
 #ifdef _MSC_VER
-          _BitScanForward64(&bitPos, bitsHere);
+      _BitScanForward64(&bitPos, bitsHere);
 #else
-          bit_pos = __builtin_ctzll(bits_here);
+      bit_pos = __builtin_ctzll(bits_here);
 #endif
 
-          const uint8_t type = voxels[AxisIndex(axis, forward + 1, bit_pos + 1, layer + 1)];
-          uint8_t& forward_merged_ref = forward_merged[bit_pos];
-
-          if ((bits_next >> bit_pos & 1) &&
-              type == voxels[AxisIndex(axis, forward + 2, bit_pos + 1, layer + 1)]) {
-            forward_merged_ref++;
-            bits_here &= ~(1ull << bit_pos);
-            continue;
-          }
-
-          for (int right = bit_pos + 1; right < CS; right++) {
-            if (!(bits_here >> right & 1) || forward_merged_ref != forward_merged[right] ||
-                type != voxels[AxisIndex(axis, forward + 1, right + 1, layer + 1)]) {
-              break;
-            }
-            forward_merged[right] = 0;
-            right_merged++;
-          }
-          bits_here &= ~((1ull << (bit_pos + right_merged)) - 1);
-
-          const uint8_t mesh_front = forward - forward_merged_ref;
-          const uint8_t mesh_left = bit_pos;
-          const uint8_t mesh_up = layer + (~face & 1);
-          const uint8_t mesh_width = right_merged;
-          const uint8_t mesh_length = forward_merged_ref + 1;
-          forward_merged_ref = 0;
-          right_merged = 1;
+      const uint8_t type = type_at(axis, forward + 1, bit_pos + 1, layer + 1);
+      uint8_t& forward_merged_ref = forward_merged[bit_pos];
+
+      if ((bits_next >> bit_pos & 1) &&
+          type == type_at(axis, forward + 2, bit_pos + 1, layer + 1)) {
+        forward_merged_ref++;
+        bits_here &= ~(1ull << bit_pos);
+        continue;
+      }
+
+      for (int right = bit_pos + 1; right < CS; right++) {
+        if (!(bits_here >> right & 1) || forward_merged_ref != forward_merged[right] ||
+            type != type_at(axis, forward + 1, right + 1, layer + 1)) {
+          break;
+        }
+        forward_merged[right] = 0;
+        right_merged++;
+      }
+      bits_here &= ~((1ull << (bit_pos + right_merged)) - 1);
+
+      const uint8_t mesh_front = forward - forward_merged_ref;
+      const uint8_t mesh_left = bit_pos;
+      const uint8_t mesh_up = layer + (~face & 1);
+      const uint8_t mesh_width = right_merged;
+      const uint8_t mesh_length = forward_merged_ref + 1;
+      forward_merged_ref = 0;
+      right_merged = 1;
 
 #ifdef PACK_QUAD
-          Quad q;
-          switch (face) {
-            case 0:
-            case 1:
-              EncodeQuad(q, mesh_front + (face == 1 ? mesh_length : 0), mesh_up, mesh_left,
+      Quad q;
+      switch (face) {
+        case 0:
+        case 1:
+          EncodeQuad(q, mesh_front + (face == 1 ? mesh_length : 0), mesh_up, mesh_left,
+                     mesh_length, mesh_width, type);
+          break;
+        default:
+          EncodeQuad(q, mesh_up, mesh_front + (face == 2 ? mesh_length : 0), mesh_left,
+                     mesh_length, mesh_width, type);
+      }
+#else
+      uint64_t q;
+      switch (face) {
+        case 0:
+        case 1:
+          q = EncodeQuad(mesh_front + (face == 1 ? mesh_length : 0), mesh_up, mesh_left,
                          mesh_length, mesh_width, type);
-              break;
-            default:
-              EncodeQuad(q, mesh_up, mesh_front + (face == 2 ? mesh_length : 0), mesh_left,
+          break;
+        default:
+          q = EncodeQuad(mesh_up, mesh_front + (face == 2 ? mesh_length : 0), mesh_left,
                          mesh_length, mesh_width, type);
-          }
-#else
-          uint64_t q;
-          switch (face) {
-            case 0:
-            case 1:
-              q = EncodeQuad(mesh_front + (face == 1 ? mesh_length : 0), mesh_up, mesh_left,
-                             mesh_length, mesh_width, type);
-              break;
-            default:
-              q = EncodeQuad(mesh_up, mesh_front + (face == 2 ? mesh_length : 0), mesh_left,
-                             mesh_length, mesh_width, type);
-          }
-#endif
-          mesh_data.vertex_cnt++;
-          InsertQuad(mesh_data.vertices, q, i_vertex);
-        }
       }
+#endif
+      emit(layer, q);
     }
-
-    const int face_vertex_length = i_vertex - face_vertex_begin;
-    alg_data.face_vertices_start_indices[face] = face_vertex_begin;
-    alg_data.face_vertex_lengths[face] = face_vertex_length;
   }
+}
 
-  // Greedy meshing faces 4-5
-  for (int face = 4; face < 6; face++) {
-    const int axis = face / 2;
+template <int Len, typename TypeAt, typename Emit>
+void GreedyFace03(int face, const MaskColumn<Len>* face_bits, BasicMeshAlgData<Len>& alg_data,
+                  TypeAt&& type_at, Emit&& emit) {
+  for (int layer = 0; layer < ChunkDims<Len>::CS; layer++) {
+    GreedyLayer03(face, layer, face_bits, alg_data, type_at, emit);
+  }
+}
 
-    const int face_vertex_begin = i_vertex;
+// Greedy merging of faces 4-5 for one face plane, see GreedyLayer03. Quads never span z, emit
+// receives the z slice (bit - 1) of each quad.
+template <int Len, typename TypeAt, typename Emit>
+void GreedyFace45(int face, const MaskColumn<Len>* face_bits, BasicMeshAlgData<Len>& alg_data,
+                  TypeAt&& type_at, Emit&& emit) {
+  constexpr int CS = ChunkDims<Len>::CS;
+  const int axis = face / 2;
+  auto& forward_merged = alg_data.forward_merged;
+  auto& right_merged = alg_data.right_merged;
 
-    for (int forward = 0; forward < CS; forward++) {
-      const int bits_location = (forward * CS) + (face * CS2);
-      const int bits_forward_location = ((forward + 1) * CS) + (face * CS2);
+  for (int forward = 0; forward < CS; forward++) {
+    const int bits_location = forward * CS;
+    const int bits_forward_location = (forward + 1) * CS;
 
-      for (int right = 0; right < CS; right++) {
-        uint64_t bits_here = face_masks[right + bits_location];
-        if (bits_here == 0) continue;
+    for (int right = 0; right < CS; right++) {
+      uint64_t bits_here = face_bits[right + bits_location];
+      if (bits_here == 0) continue;
 
-        const uint64_t bits_forward =
-            forward < CS - 1 ? face_masks[right + bits_forward_location] : 0;
-        const uint64_t bits_right = right < CS - 1 ? face_masks[right + 1 + bits_location] : 0;
-        const int right_cs = right * CS;
+      const uint64_t bits_forward = forward < CS - 1 ? face_bits[right + bits_forward_location] : 0;
+      const uint64_t bits_right = right < CS - 1 ? face_bits[right + 1 + bits_location] : 0;
+      const int right_cs = right * CS;
 
-        while (bits_here) {
-          uint64_t bit_pos;
+      while (bits_here) {
+        uint64_t bit_pos;
 #ifdef _MSC_VER
-          _BitScanForward64(&bitPos, bitsHere);
+        _BitScanForward64(&bitPos, bitsHere);
 #else
-          bit_pos = __builtin_ctzll(bits_here);
+        bit_pos = __builtin_ctzll(bits_here);
 #endif
 
-          bits_here &= ~(1ull << bit_pos);
+        bits_here &= ~(1ull << bit_pos);
 
-          const uint8_t type = voxels[AxisIndex(axis, right + 1, forward + 1, bit_pos)];
-          uint8_t& forward_merged_ref = forward_merged[right_cs + (bit_pos - 1)];
-          uint8_t& right_merged_ref = right_merged[bit_pos - 1];
+        const uint8_t type = type_at(axis, right + 1, forward + 1, bit_pos);
+        uint8_t& forward_merged_ref = forward_merged[right_cs + (bit_pos - 1)];
+        uint8_t& right_merged_ref = right_merged[bit_pos - 1];
 
-          if (right_merged_ref == 0 && (bits_forward >> bit_pos & 1) &&
-              type == voxels[AxisIndex(axis, right + 1, forward + 2, bit_pos)]) {
-            forward_merged_ref++;
-            continue;
-          }
+        if (right_merged_ref == 0 && (bits_forward >> bit_pos & 1) &&
+            type == type_at(axis, right + 1, forward + 2, bit_pos)) {
+          forward_merged_ref++;
+          continue;
+        }
 
-          if ((bits_right >> bit_pos & 1) &&
-              forward_merged_ref == forward_merged[(right_cs + CS) + (bit_pos - 1)] &&
-              type == voxels[AxisIndex(axis, right + 2, forward + 1, bit_pos)]) {
-            forward_merged_ref = 0;
-            right_merged_ref++;
-            continue;
-          }
+        if ((bits_right >> bit_pos & 1) &&
+            forward_merged_ref == forward_merged[(right_cs + CS) + (bit_pos - 1)] &&
+            type == type_at(axis, right + 2, forward + 1, bit_pos)) {
+          forward_merged_ref = 0;
+          right_merged_ref++;
+          continue;
+        }
 
-          const uint8_t mesh_left = right - right_merged_ref;
-          const uint8_t mesh_front = forward - forward_merged_ref;
-          const uint8_t mesh_up = bit_pos - 1 + (~face & 1);
-          const uint8_t mesh_width = 1 + right_merged_ref;
-          const uint8_t mesh_length = 1 + forward_merged_ref;
+        const uint8_t mesh_left = right - right_merged_ref;
+        const uint8_t mesh_front = forward - forward_merged_ref;
+        const uint8_t mesh_up = bit_pos - 1 + (~face & 1);
+        const uint8_t mesh_width = 1 + right_merged_ref;
+        const uint8_t mesh_length = 1 + forward_merged_ref;
 
-          forward_merged_ref = 0;
-          right_merged_ref = 0;
+        forward_merged_ref = 0;
+        right_merged_ref = 0;
 
 #ifdef PACK_QUAD
-          Quad q;
-          EncodeQuad(q, mesh_left + (face == 4 ? mesh_width : 0), mesh_front, mesh_up, mesh_width,
-                     mesh_length, type);
+        Quad q;
+        EncodeQuad(q, mesh_left + (face == 4 ? mesh_width : 0), mesh_front, mesh_up, mesh_width,
+                   mesh_length, type);
 #else
-          uint64_t q = EncodeQuad(mesh_left + (face == 4 ? mesh_width : 0), mesh_front, mesh_up,
-                                  mesh_width, mesh_length, type);
+        uint64_t q = EncodeQuad(mesh_left + (face == 4 ? mesh_width : 0), mesh_front, mesh_up,
+                                mesh_width, mesh_length, type);
 #endif
+        emit(bit_pos - 1, q);
+      }
+    }
+  }
+}
+
+// Per-material column masks in the padded [y][x] layout of PaddedChunkMask, plus the face plane
+// of the material being merged. Thread local since it is too large to keep per MeshAlgData.
+struct MaterialPlaneScratch {
+  std::vector<uint64_t> planes =
+      std::vector<uint64_t>(static_cast<size_t>(MaxMaterialPlanes) * PCS2);
+  std::array<uint64_t, CS2> face_bits;
+  std::array<uint8_t, 256> slots;
+  std::array<uint8_t, MaxMaterialPlanes> materials;
+  int count{};
+};
 
-          mesh_data.vertex_cnt++;
-          InsertQuad(mesh_data.vertices, q, i_vertex);
+// One pass over the interior voxels with at least one visible face, so buried voxels are never
+// read. Returns false if the chunk has too many materials.
+bool BuildMaterialPlanes(std::span<const uint8_t> voxels, const uint64_t* face_masks,
+                         MaterialPlaneScratch& scratch) {
+  ZoneScoped;
+  constexpr uint8_t NoSlot = 0xFF;
+  scratch.slots.fill(NoSlot);
+  scratch.count = 0;
+  for (int y = 1; y < PCS - 1; y++) {
+    for (int x = 1; x < PCS - 1; x++) {
+      const int col = (y * PCS) + x;
+      const int i = (x - 1) + ((y - 1) * CS);
+      const int i_t = (y - 1) + ((x - 1) * CS);
+      uint64_t bits = ((face_masks[i] | face_masks[CS2 + i] | face_masks[(2 * CS2) + i_t] |
+                        face_masks[(3 * CS2) + i_t])
+                       << 1) |
+                      face_masks[(4 * CS2) + i] | face_masks[(5 * CS2) + i];
+      const uint8_t* row = voxels.data() + (x * PCS) + (y * PCS2);
+      while (bits) {
+        const int z = std::countr_zero(bits);
+        bits &= bits - 1;
+        const uint8_t type = row[z];
+        uint8_t slot = scratch.slots[type];
+        if (slot == NoSlot) {
+          if (scratch.count == MaxMaterialPlanes) return false;
+          slot = scratch.count++;
+          scratch.slots[type] = slot;
+          scratch.materials[slot] = type;
+          memset(scratch.planes.data() + (static_cast<size_t>(slot) * PCS2), 0,
+                 PCS2 * sizeof(uint64_t));
         }
+        scratch.planes[(static_cast<size_t>(slot) * PCS2) + col] |= 1ull << z;
+      }
+    }
+  }
+  return true;
+}
+
+// Restricts one culled face plane to the voxels of a single material. Returns false if the
+// material has no faces in this direction.
+bool RestrictFaceToMaterial(int face, const uint64_t* face_bits, const uint64_t* plane,
+                            uint64_t* out) {
+  uint64_t any = 0;
+  if (face == 2 || face == 3) {
+    for (int x = 1; x < PCS - 1; x++) {
+      for (int y = 1; y < PCS - 1; y++) {
+        const int i = (y - 1) + ((x - 1) * CS);
+        out[i] = face_bits[i] & (plane[(y * PCS) + x] >> 1);
+        any |= out[i];
+      }
+    }
+  } else {
+    const int shift = face < 2 ? 1 : 0;
+    for (int y = 1; y < PCS - 1; y++) {
+      for (int x = 1; x < PCS - 1; x++) {
+        const int i = (x - 1) + ((y - 1) * CS);
+        out[i] = face_bits[i] & (plane[(y * PCS) + x] >> shift);
+        any |= out[i];
       }
     }
+  }
+  return any != 0;
+}
+
+thread_local MaterialPlaneScratch material_plane_scratch;
+
+// Bit s of dirty[face] marks slice s of that face. Faces 0-3 slice by layer, faces 4-5 by z - 1.
+using DirtySlices = std::array<uint64_t, 6>;
+
+void RemeshSlices(std::span<uint8_t> voxels, MeshAlgData& alg_data, const DirtySlices& dirty,
+                  IncrementalMeshData& mesh) {
+  ZoneScoped;
+  auto type_at = [voxels](int axis, int a, int b, int c) {
+    return voxels[AxisIndex<PCS>(axis, a, b, c)];
+  };
+  auto emit = [&mesh](int face, int slice, const auto& q) {
+    AppendQuad(mesh.slices[(face * CS) + slice], q);
+  };
+  for (int face = 0; face < 6; face++) {
+    if (!dirty[face]) continue;
+    const uint64_t* face_bits = mesh.face_masks.data() + (face * CS2);
+    for (uint64_t bits = dirty[face]; bits; bits &= bits - 1) {
+      mesh.slices[(face * CS) + std::countr_zero(bits)].clear();
+    }
+    if (face < 4) {
+      for (uint64_t bits = dirty[face]; bits; bits &= bits - 1) {
+        GreedyLayer03(face, std::countr_zero(bits), face_bits, alg_data, type_at,
+                      [&emit, face](int slice, const auto& q) { emit(face, slice, q); });
+      }
+    } else {
+      // faces 4-5 merge across the whole plane, so only keep the dirty z bits. alg_data's face
+      // masks are scratch here, the incremental state keeps its own.
+      const uint64_t z_bits = dirty[face] << 1;
+      uint64_t* masked = alg_data.face_masks.data() + (face * CS2);
+      for (int i = 0; i < CS2; i++) {
+        masked[i] = face_bits[i] & z_bits;
+      }
+      GreedyFace45(face, masked, alg_data, type_at,
+                   [&emit, face](int slice, const auto& q) { emit(face, slice, q); });
+    }
+  }
+
+  int i_vertex = 0;
+  for (int face = 0; face < 6; face++) {
+    mesh.face_vertices_start_indices[face] = i_vertex;
+    for (int slice = 0; slice < CS; slice++) {
+      i_vertex += static_cast<int>(mesh.slices[(face * CS) + slice].size() / QuadWordCount);
+    }
+    mesh.face_vertex_lengths[face] = i_vertex - mesh.face_vertices_start_indices[face];
+  }
+  mesh.vertex_cnt = i_vertex;
+}
+
+// The greedy merge of GenerateMesh, over face masks already culled into alg_data.
+template <int Len>
+void MergeCulledFaces(std::span<uint8_t> voxels, BasicMeshAlgData<Len>& alg_data, MeshSink& sink) {
+  using D = ChunkDims<Len>;
+  int i_vertex{0};
+  auto& face_masks = alg_data.face_masks;
+  QuadWord* vertices = sink.Reserve(MaxQuads(alg_data.face_counts));
+  auto emit = [vertices, &i_vertex](int, const auto& q) { InsertQuad(vertices, q, i_vertex); };
+
+  auto type_at = [voxels](int axis, int a, int b, int c) {
+    return voxels[AxisIndex<Len>(axis, a, b, c)];
+  };
+  for (int face = 0; face < 6; face++) {
+    const int face_vertex_begin = i_vertex;
+    const MaskColumn<Len>* face_bits = face_masks.data() + (face * D::CS2);
+    if (face < 4) {
+      GreedyFace03(face, face_bits, alg_data, type_at, emit);
+    } else {
+      GreedyFace45(face, face_bits, alg_data, type_at, emit);
+    }
+    alg_data.face_vertices_start_indices[face] = face_vertex_begin;
+    alg_data.face_vertex_lengths[face] = i_vertex - face_vertex_begin;
+  }
+
+  sink.Commit(i_vertex);
+}
+
+}  // namespace
+
+void SetCullKernel(CullKernel kernel) {
+  cull_faces = GetCullFacesFn(kernel);
+  cull_kernel = std::min(kernel, BestCullKernel());
+}
+
+CullKernel GetCullKernel() { return cull_kernel; }
+
+template <int Len>
+void GenerateMesh(std::span<uint8_t> voxels, BasicMeshAlgData<Len>& alg_data, MeshSink& sink) {
+  ZoneScoped;
+  if constexpr (Len == PCS) {
+    cull_faces(alg_data.mask->mask.data(), alg_data.face_masks.data(),
+               alg_data.face_counts.data());
+  } else {
+    CullFacesScalar<Len>(alg_data.mask->mask.data(), alg_data.face_masks.data(),
+                         alg_data.face_counts.data());
+  }
+  MergeCulledFaces(voxels, alg_data, sink);
+}
+
+template <int Len>
+void GenerateMesh(std::span<uint8_t> voxels, BasicMeshAlgData<Len>& alg_data,
+                  MesherOutputData& mesh_data) {
+  Timer t;
+  VectorMeshSink sink{mesh_data};
+  GenerateMesh(voxels, alg_data, sink);
+  mesh_data.mesh_time = t.ElapsedMicro();
+}
+
+template void GenerateMesh<32>(std::span<uint8_t>, BasicMeshAlgData<32>&, MeshSink&);
+template void GenerateMesh<64>(std::span<uint8_t>, BasicMeshAlgData<64>&, MeshSink&);
+template void GenerateMesh<32>(std::span<uint8_t>, BasicMeshAlgData<32>&, MesherOutputData&);
+template void GenerateMesh<64>(std::span<uint8_t>, BasicMeshAlgData<64>&, MesherOutputData&);
 
-    const int face_vertex_length = i_vertex - face_vertex_begin;
+void GenerateMeshMaterialPlanes(std::span<uint8_t> voxels, MeshAlgData& alg_data, MeshSink& sink) {
+  ZoneScoped;
+  auto& face_masks = alg_data.face_masks;
+  cull_faces(alg_data.mask->mask.data(), face_masks.data(), alg_data.face_counts.data());
+
+  auto& scratch = material_plane_scratch;
+  if (!BuildMaterialPlanes(voxels, face_masks.data(), scratch)) {
+    MergeCulledFaces(voxels, alg_data, sink);
+    return;
+  }
+
+  QuadWord* vertices = sink.Reserve(MaxQuads(alg_data.face_counts));
+  int i_vertex{0};
+  auto emit = [vertices, &i_vertex](int, const auto& q) { InsertQuad(vertices, q, i_vertex); };
+  for (int face = 0; face < 6; face++) {
+    const int face_vertex_begin = i_vertex;
+    const uint64_t* face_bits = face_masks.data() + (face * CS2);
+    for (int slot = 0; slot < scratch.count; slot++) {
+      // a single material owns every visible face, no need to split the plane
+      const uint64_t* material_face_bits = face_bits;
+      if (scratch.count > 1) {
+        const uint64_t* plane = scratch.planes.data() + (static_cast<size_t>(slot) * PCS2);
+        if (!RestrictFaceToMaterial(face, face_bits, plane, scratch.face_bits.data())) {
+          continue;
+        }
+        material_face_bits = scratch.face_bits.data();
+      }
+      const uint8_t material = scratch.materials[slot];
+      auto type_at = [material](int, int, int, int) { return material; };
+      if (face < 4) {
+        GreedyFace03(face, material_face_bits, alg_data, type_at, emit);
+      } else {
+        GreedyFace45(face, material_face_bits, alg_data, type_at, emit);
+      }
+    }
     alg_data.face_vertices_start_indices[face] = face_vertex_begin;
-    alg_data.face_vertex_lengths[face] = face_vertex_length;
+    alg_data.face_vertex_lengths[face] = i_vertex - face_vertex_begin;
   }
 
+  sink.Commit(i_vertex);
+}
+
+void GenerateMeshMaterialPlanes(std::span<uint8_t> voxels, MeshAlgData& alg_data,
+                                MesherOutputData& mesh_data) {
+  Timer t;
+  VectorMeshSink sink{mesh_data};
+  GenerateMeshMaterialPlanes(voxels, alg_data, sink);
   mesh_data.mesh_time = t.ElapsedMicro();
 }
+
+void GenerateSolidChunkMesh(uint8_t material, MeshAlgData& alg_data, MeshSink& sink) {
+  ZoneScoped;
+  auto& face_masks = alg_data.face_masks;
+  cull_faces(alg_data.mask->mask.data(), face_masks.data(), alg_data.face_counts.data());
+  QuadWord* vertices = sink.Reserve(MaxQuads(alg_data.face_counts));
+  int i_vertex{0};
+  auto emit = [vertices, &i_vertex](int, const auto& q) { InsertQuad(vertices, q, i_vertex); };
+  auto type_at = [material](int, int, int, int) { return material; };
+  for (int face = 0; face < 6; face++) {
+    const int face_vertex_begin = i_vertex;
+    const uint64_t* face_bits = face_masks.data() + (face * CS2);
+    if (face < 4) {
+      GreedyLayer03(face, 0, face_bits, alg_data, type_at, emit);
+      GreedyLayer03(face, CS - 1, face_bits, alg_data, type_at, emit);
+    } else {
+      // faces 4-5 are columns along z, only their end bits can be set
+      GreedyFace45(face, face_bits, alg_data, type_at, emit);
+    }
+    alg_data.face_vertices_start_indices[face] = face_vertex_begin;
+    alg_data.face_vertex_lengths[face] = i_vertex - face_vertex_begin;
+  }
+
+  sink.Commit(i_vertex);
+}
+
+void GenerateMeshIncremental(std::span<uint8_t> voxels, MeshAlgData& alg_data,
+                             IncrementalMeshData& mesh) {
+  ZoneScoped;
+  cull_faces(alg_data.mask->mask.data(), mesh.face_masks.data(), alg_data.face_counts.data());
+  DirtySlices dirty;
+  dirty.fill((1ull << CS) - 1);
+  RemeshSlices(voxels, alg_data, dirty, mesh);
+}
+
+void RemeshVoxels(std::span<uint8_t> voxels, MeshAlgData& alg_data,
+                  std::span<const ivec3> modified, IncrementalMeshData& mesh) {
+  ZoneScoped;
+  const uint64_t* opaque_mask = alg_data.mask->mask.data();
+  auto& face_masks = mesh.face_masks;
+  DirtySlices dirty{};
+  auto recull = [&](int x, int y) {
+    if (x < 1 || x > CS || y < 1 || y > CS) return;
+    const int ba_index = (x - 1) + ((y - 1) * CS);
+    const int ab_index = (y - 1) + ((x - 1) * CS);
+    const int indices[6] = {ba_index, ba_index, ab_index, ab_index, ba_index, ba_index};
+    uint64_t prev[6];
+    for (int face = 0; face < 6; face++) {
+      prev[face] = face_masks[(face * CS2) + indices[face]];
+    }
+    CullColumn<PCS>(opaque_mask, face_masks.data(), y, x);
+    for (int face = 0; face < 6; face++) {
+      const uint64_t changed = prev[face] ^ face_masks[(face * CS2) + indices[face]];
+      if (!changed) continue;
+      if (face < 4) {
+        dirty[face] |= 1ull << (indices[face] / CS);
+      } else {
+        dirty[face] |= changed >> 1;
+      }
+    }
+  };
+
+  for (const ivec3& pos : modified) {
+    // neighbors whose faces may have been uncovered or hidden
+    recull(pos.x, pos.y);
+    recull(pos.x - 1, pos.y);
+    recull(pos.x + 1, pos.y);
+    recull(pos.x, pos.y - 1);
+    recull(pos.x, pos.y + 1);
+    // a material change keeps the face masks but changes the merge
+    if (pos.x >= 1 && pos.x <= CS && pos.y >= 1 && pos.y <= CS && pos.z >= 1 && pos.z <= CS) {
+      dirty[0] |= 1ull << (pos.y - 1);
+      dirty[1] |= 1ull << (pos.y - 1);
+      dirty[2] |= 1ull << (pos.x - 1);
+      dirty[3] |= 1ull << (pos.x - 1);
+      dirty[4] |= 1ull << (pos.z - 1);
+      dirty[5] |= 1ull << (pos.z - 1);
+    }
+  }
+  RemeshSlices(voxels, alg_data, dirty, mesh);
+}
+
+void AppendRemeshBox(ivec3 min, ivec3 max, std::vector<ivec3>& modified) {
+  // Slices are only dirtied by interior positions, padding changes reach them through the recull
+  const ivec3 inner_min = glm::clamp(min, ivec3{1}, ivec3{CS});
+  const int inner_max_z = std::min(max.z, CS + 1);
+  for (int y = min.y; y < max.y; y++) {
+    for (int x = min.x; x < max.x; x++) modified.emplace_back(x, y, inner_min.z);
+  }
+  for (int z = inner_min.z; z < inner_max_z; z++) {
+    modified.emplace_back(inner_min.x, inner_min.y, z);
+  }
+}
+
+void CopyIncrementalMesh(const IncrementalMeshData& mesh, MeshSink& sink) {
+  ZoneScoped;
+  QuadWord* vertices = sink.Reserve(mesh.vertex_cnt);
+  for (const auto& slice : mesh.slices) {
+    if (slice.empty()) continue;
+    memcpy(vertices, slice.data(), slice.size() * sizeof(QuadWord));
+    vertices += slice.size();
+  }
+  sink.Commit(mesh.vertex_cnt);
+}
+
+void CopyIncrementalMesh(const IncrementalMeshData& mesh, MesherOutputData& mesh_data) {
+  VectorMeshSink sink{mesh_data};
+  CopyIncrementalMesh(mesh, sink);
+}
@@ -5,24 +5,96 @@
 
 #include "Mask.hpp"
 
-struct MeshAlgData {
-  std::array<uint64_t, static_cast<std::size_t>(CS2 * 6)> face_masks;
-  std::array<uint8_t, CS2> forward_merged;
-  std::array<uint8_t, CS> right_merged;
+template <int Len>
+struct BasicMeshAlgData {
+  using Dims = ChunkDims<Len>;
+  std::array<MaskColumn<Len>, static_cast<std::size_t>(Dims::CS2 * 6)> face_masks;
+  std::array<uint8_t, Dims::CS2> forward_merged;
+  std::array<uint8_t, Dims::CS> right_merged;
+  // Visible faces per direction, written by culling. Each face becomes at most one quad.
+  std::array<uint32_t, 6> face_counts{};
   std::array<int, 6> face_vertices_start_indices{};
   std::array<int, 6> face_vertex_lengths{};
-  PaddedChunkMask* mask{};
+  BasicPaddedChunkMask<Len>* mask{};
 };
 
-struct MesherOutputData {
+using MeshAlgData = BasicMeshAlgData<PCS>;
+
 #ifdef PACK_QUAD
-  using VertexVec = std::vector<uint8_t>;
+using QuadWord = uint8_t;
+constexpr int QuadWordCount = 5;
 #else
-  using VertexVec = std::vector<uint64_t>;
+using QuadWord = uint64_t;
+constexpr int QuadWordCount = 1;
 #endif
+
+// Destination of the mesher output. Reserve is called once per mesh, after culling, with an upper
+// bound on the quad count and must return room for that many quads, or nullptr if the bound is 0.
+// Commit is called once with the number of quads actually written.
+class MeshSink {
+ public:
+  virtual QuadWord* Reserve(uint32_t max_quads) = 0;
+  virtual void Commit(uint32_t quad_cnt) = 0;
+
+ protected:
+  ~MeshSink() = default;
+};
+
+struct MesherOutputData {
+  using VertexVec = std::vector<QuadWord>;
   VertexVec vertices;
   int vertex_cnt{};
   float mesh_time;
 };
 
-void GenerateMesh(std::span<uint8_t> voxels, MeshAlgData& alg_data, MesherOutputData& mesh_data);
+// Which kernel the hidden face culling pass uses. The best one the CPU supports is picked at
+// startup; requesting an unsupported one falls back to the next best.
+enum class CullKernel : uint8_t { Scalar, AVX2, AVX512 };
+void SetCullKernel(CullKernel kernel);
+CullKernel GetCullKernel();
+
+// Instantiated for padded lengths 32 and 64. Only 64 uses the SIMD culling kernels.
+template <int Len>
+void GenerateMesh(std::span<uint8_t> voxels, BasicMeshAlgData<Len>& alg_data, MeshSink& sink);
+template <int Len>
+void GenerateMesh(std::span<uint8_t> voxels, BasicMeshAlgData<Len>& alg_data,
+                  MesherOutputData& mesh_data);
+
+// Produces the same quads as GenerateMesh, grouped by material within each face. Builds a column
+// bitmask per material in one pass over the solid voxels, then greedy merges each material
+// separately with bitwise ops only, instead of comparing voxel bytes for every merge candidate.
+// Chunks with more than MaxMaterialPlanes materials fall back to GenerateMesh's merge over the
+// faces already culled.
+constexpr int MaxMaterialPlanes = 16;
+void GenerateMeshMaterialPlanes(std::span<uint8_t> voxels, MeshAlgData& alg_data, MeshSink& sink);
+void GenerateMeshMaterialPlanes(std::span<uint8_t> voxels, MeshAlgData& alg_data,
+                                MesherOutputData& mesh_data);
+
+// Mesh of a chunk whose interior is all material, from alg_data.mask alone. Only the border layers
+// can have faces, toward air in the padding, so no voxel is read and only those layers are merged.
+void GenerateSolidChunkMesh(uint8_t material, MeshAlgData& alg_data, MeshSink& sink);
+
+// Mesh of one chunk kept as the quads of every (face, slice), a slice being one plane along the
+// face normal. Greedy quads never span slices, so an edit only regenerates the slices it touches
+// and patches the per-face ranges.
+struct IncrementalMeshData {
+  std::array<uint64_t, static_cast<std::size_t>(CS2 * 6)> face_masks;
+  std::array<std::vector<QuadWord>, static_cast<std::size_t>(CS * 6)> slices;
+  std::array<int, 6> face_vertices_start_indices{};
+  std::array<int, 6> face_vertex_lengths{};
+  int vertex_cnt{};
+};
+
+void GenerateMeshIncremental(std::span<uint8_t> voxels, MeshAlgData& alg_data,
+                             IncrementalMeshData& mesh);
+// modified holds padded chunk positions already written to voxels and the mask. Only the culled
+// columns around them and the slices whose faces changed are redone.
+void RemeshVoxels(std::span<uint8_t> voxels, MeshAlgData& alg_data,
+                  std::span<const ivec3> modified, IncrementalMeshData& mesh);
+// Appends modified positions for RemeshVoxels covering every voxel of the padded box [min, max).
+// Each position reculls the columns around it and dirties its slices, so one layer of the box and
+// one column through it stand in for the rest.
+void AppendRemeshBox(ivec3 min, ivec3 max, std::vector<ivec3>& modified);
+// Writes the slices to the sink face by face, matching face_vertices_start_indices.
+void CopyIncrementalMesh(const IncrementalMeshData& mesh, MeshSink& sink);
+void CopyIncrementalMesh(const IncrementalMeshData& mesh, MesherOutputData& mesh_data);
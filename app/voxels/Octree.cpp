@@ -14,6 +14,10 @@
 // it
 namespace {
 AutoCVarFloat lod_thresh("terrain.lod_thresh", "lod threshold of terrain", 10.0);
+AutoCVarFloat terrain_freq("terrain.freq", "freq of terrain", 0.00005);
+AutoCVarInt terrain_max_height("terrain.maxheight", "max height", 10000);
+AutoCVarInt height_map_cache_mb("terrain.height_map_cache_mb",
+                                "Height map cache memory budget in MiB, applies on restart", 256);
 
 template <typename T>
 void DumpBits(T d, size_t size = sizeof(T)) {
@@ -33,10 +37,10 @@ void MeshOctree::Init() {
 
   terrain_tasks_.Init(max_tasks);
   chunk_pool_.Init(1000);
-  height_map_pool_.Init(50000);
+  height_pyramid_.Init(&noise_, TerrainParams(),
+                       static_cast<size_t>(height_map_cache_mb.Get()) << 20);
   // TODO: fine tune
   mesh_alg_buf_.Init(1000);
-  mesher_output_data_buf_.Init(1000);
 
   prev_cam_chunk_pos_ = ivec3{INT_MAX};
 
@@ -126,7 +130,7 @@ void MeshOctree::Reset() {
     n.Clear();
   }
   AllocNode(0);
-  height_maps_.clear();
+  height_pyramid_.Reset(TerrainParams());
 }
 
 void MeshOctree::Update(vec3 cam_pos) {
@@ -260,14 +264,6 @@ void MeshOctree::Update(vec3 cam_pos) {
     }
   }
 
-  {
-    auto now = std::chrono::steady_clock::now();
-    if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last_height_map_cleanup_time_) >
-        std::chrono::milliseconds(1000)) {
-      ClearOldHeightMaps(now);
-      last_height_map_cleanup_time_ = now;
-    }
-  }
 }
 
 void MeshOctree::OnImGui() {
@@ -279,7 +275,11 @@ void MeshOctree::OnImGui() {
       ImGui::Text("%d: %zu", i, s);
     }
     ImGui::Text("Total Nodes: %zu", tot_nodes_cnt);
-    ImGui::Text("height maps: %zu", height_maps_.size());
+    const auto& tiles = height_pyramid_.Tiles();
+    auto hm_stats = tiles.GetStats();
+    ImGui::Text("height tiles: %zu/%zu, hits %lu, misses %lu, waits %lu, evictions %lu",
+                tiles.Size(), tiles.Capacity(), hm_stats.hits, hm_stats.misses, hm_stats.waits,
+                hm_stats.evictions);
     ImGui::Text("terrain: to complete %zu, done %zu, in flight %zu",
                 terrain_tasks_.to_complete.size(), terrain_tasks_.done_tasks.size_approx(),
                 terrain_tasks_.InFlight());
@@ -342,42 +342,20 @@ void MeshOctree::UpdateLodBounds() {
   std::ranges::reverse(lod_bounds_);
 }
 
-void MeshOctree::ClearOldHeightMaps(const std::chrono::steady_clock::time_point& now) {
-  ZoneScoped;
-  std::lock_guard<std::mutex> lock(height_map_mtx_);
-  for (auto it = height_maps_.begin(); it != height_maps_.end();) {
-    if (std::chrono::duration_cast<std::chrono::milliseconds>(now - it->second.access) >
-        std::chrono::milliseconds(1000)) {
-      height_map_pool_.Free(it->second.height_map_pool_handle);
-      it = height_maps_.erase(it);
-    } else {
-      ++it;
-    }
-  }
-}
-
 void MeshOctree::ProcessTerrainTask(TerrainGenTask& task) {
   ZoneScoped;
   auto& chunk = *task.chunk;
   chunk.grid.Clear();
-  auto& hm = GetHeightMap(chunk.pos.x, chunk.pos.z, task.node_key.lod);
+  const int level = static_cast<int>(max_depth_ - task.node_key.lod);
+  const int scale = 1 << level;
+  HeightMapData hm;
+  height_pyramid_.GetHeightMap(ivec2{chunk.pos.x, chunk.pos.z} / scale, level, hm);
   if (!ChunkInHeightMapRange(hm.range, task.node_key.lod, chunk.pos)) {
     return;
   }
   // int color = 128;
   int color = task.node_key.lod * 30;
-  int scale = (1 << (max_depth_ - task.node_key.lod));
-  for (int y = 0; y < PaddedChunkGrid3D::Dims.y; y++) {
-    int adj_y = (y * scale) + chunk.pos.y;
-    int i = 0;
-    for (int z = 0; z < PaddedChunkGrid3D::Dims.z; z++) {
-      for (int x = 0; x < PaddedChunkGrid3D::Dims.x; x++, i++) {
-        if (adj_y < ((hm.heights[i]))) {
-          chunk.grid.Set(x, y, z, color);
-        }
-      }
-    }
-  }
+  gen::FillChunkColumns(chunk.grid, hm.heights, chunk.pos.y, scale, color);
   // gen::FillChunkNoCheck(chunk->grid, chunk->pos, hm, [c](int, int, int) { return c; });
 }
 
@@ -387,59 +365,26 @@ void MeshOctree::ProcessMeshGenTask(MeshGenTask& task) {
   auto& chunk = *task.chunk;
 
   MeshAlgData* alg_data{};
-  MesherOutputData* data{};
   {
-    std::lock_guard<std::mutex> lock(height_map_mtx_);
+    std::lock_guard<std::mutex> lock(mesh_alg_data_mtx_);
     alg_data = mesh_alg_buf_.Allocate();
-    data = mesher_output_data_buf_.Allocate();
   }
-  EASSERT(alg_data && data);
+  EASSERT(alg_data);
   alg_data->mask = &chunk.grid.mask;
-  GenerateMesh(chunk.grid.grid.grid, *alg_data, *data);
-  task.vert_count = data->vertex_cnt;
-  if (data->vertex_cnt) {
-    task.staging_copy_idx =
-        ChunkMeshManager::Get().CopyChunkToStaging(data->vertices.data(), data->vertex_cnt);
+  // octree chunks use a single material per lod
+  StagingMeshSink sink;
+  GenerateMeshMaterialPlanes(chunk.grid.grid.grid, *alg_data, sink);
+  task.vert_count = sink.vertex_cnt;
+  if (sink.vertex_cnt) {
+    task.staging_copy_idx = sink.staging_copy_idx;
     for (int i = 0; i < 6; i++) {
       task.vert_counts[i] = alg_data->face_vertex_lengths[i];
     }
   }
 }
 
-HeightMapData& MeshOctree::GetHeightMap(int x, int z, int lod) {
-  ZoneScoped;
-#define LOCK_HM std::lock_guard<std::mutex> lock(height_map_mtx_)
-  // #define LOCK_HM
-  {
-    LOCK_HM;
-    auto it = height_maps_.find({x, z, lod});
-    if (it != height_maps_.end()) {
-      it->second.access = std::chrono::steady_clock::now();
-      return *height_map_pool_.Get(it->second.height_map_pool_handle);
-    }
-  }
-  uint32_t handle;
-  {
-    LOCK_HM;
-    handle = height_map_pool_.Alloc();
-  }
-  HeightMapData* hm = height_map_pool_.Get(handle);
-
-  uint32_t scale = (1 << (max_depth_ - lod));
-  static AutoCVarFloat freq("terrain.freq", "freq of terrain", 0.00005);
-  float adj_freq = freq.GetFloat() * static_cast<float>(scale);
-  HeightMapFloats floats;
-  noise_.fbm->GenUniformGrid2D(floats.data(), x / scale, z / scale, PCS, PCS, adj_freq, seed_);
-  static AutoCVarInt maxheight("terrain.maxheight", "max height", 10000);
-  gen::NoiseToHeights(floats, *hm, {0, maxheight.Get()});
-
-  OctreeHeightMapData data{.access = std::chrono::steady_clock::now(),
-                           .height_map_pool_handle = handle};
-  {
-    LOCK_HM;
-    height_maps_.emplace(ivec3{x, z, lod}, data);
-  }
-  return *hm;
+HeightPyramid::Params MeshOctree::TerrainParams() {
+  return {.frequency = terrain_freq.GetFloat(), .max_height = terrain_max_height.Get()};
 }
 
 bool MeshOctree::ShouldMeshChunk(ivec3 pos, uint32_t lod) {
@@ -13,6 +13,7 @@
 #include <glm/gtx/hash.hpp>
 
 #include "voxels/Common.hpp"
+#include "voxels/HeightPyramid.hpp"
 #include "voxels/Mesher.hpp"
 #include "voxels/Terrain.hpp"
 
@@ -145,11 +146,6 @@ struct MeshOctree {
     uint32_t lod;
     uint32_t node_generation;
   };
-  struct OctreeHeightMapData {
-    // HeightMapData data;
-    std::chrono::steady_clock::time_point access;
-    uint32_t height_map_pool_handle;
-  };
   struct MeshGenTask {
     NodeKey node_key;
     Chunk* chunk;
@@ -184,16 +180,12 @@ struct MeshOctree {
   // std::array<NodeList<Node>, AbsoluteMaxDepth + 1> nodes_;
   MultiLevelNodeList<Node, AbsoluteMaxDepth + 1> nodes_;
   std::vector<NodeQueueItem> child_free_stack_;
-  std::unordered_map<ivec3, OctreeHeightMapData> height_maps_;
-  std::mutex height_map_mtx_;
-  PtrObjPool<HeightMapData> height_map_pool_;
-  std::chrono::steady_clock::time_point last_height_map_cleanup_time_;
+  HeightPyramid height_pyramid_;
   std::chrono::steady_clock::time_point last_octree_update_time_;
   TaskPool2<TerrainGenTask, MeshGenTask> terrain_tasks_;
   std::mutex mesh_alg_data_mtx_;
   RingBuffer<Chunk> chunk_pool_;
   RingBuffer<MeshAlgData> mesh_alg_buf_;
-  RingBuffer<MesherOutputData> mesher_output_data_buf_;
   ivec3 prev_cam_chunk_pos_;
   ivec3 curr_cam_chunk_pos_;
   vec3 curr_cam_pos_;
@@ -210,13 +202,11 @@ struct MeshOctree {
   void ProcessTerrainTask(TerrainGenTask& task);
   void ProcessMeshGenTask(MeshGenTask& task);
   [[nodiscard]] uint32_t GetOffset(uint32_t depth) const { return (1 << depth) * CS; }
-  void ClearOldHeightMaps(const std::chrono::steady_clock::time_point& now);
   uint32_t ChunkLenFromDepth(uint32_t depth) { return PCS * (1 << (AbsoluteMaxDepth - depth)); }
   void FillNoise(HeightMapFloats& floats, ivec2 pos) const {
     noise_.white_noise->GenUniformGrid2D(floats.data(), pos.x, pos.y, PCS, PCS, freq_, seed_);
   }
-  // uint32_t GetHeightMap(int x, int z, int lod);
-  HeightMapData& GetHeightMap(int x, int z, int lod);
+  static HeightPyramid::Params TerrainParams();
   void UpdateLodBounds();
   void Validate();
   bool ChunkInHeightMapRange(ivec2 hm_range, int lod, ivec3 chunk_pos) {
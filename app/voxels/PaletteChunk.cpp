@@ -0,0 +1,170 @@
+#include "PaletteChunk.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+
+static_assert(std::endian::native == std::endian::little, "rows are decoded a byte at a time");
+
+using PaletteIndex = std::array<uint8_t, 256>;
+
+bool UniformRow(const uint8_t* row) {
+  uint64_t first;
+  memcpy(&first, row, sizeof(first));
+  if (first != row[0] * 0x0101010101010101ull) return false;
+  for (int i = 8; i < PCS; i += 8) {
+    uint64_t word;
+    memcpy(&word, row + i, sizeof(word));
+    if (word != first) return false;
+  }
+  return true;
+}
+
+template <int Bits>
+void PackRows(const Grid3Du8<PCS>& voxels, const PaletteIndex& index, uint64_t* words) {
+  constexpr int PerWord = 64 / Bits;
+  // index i repeated in every field of a word
+  constexpr uint64_t Repeat = ~0ull / ((1ull << Bits) - 1);
+  for (int row = 0; row < PCS2; row++) {
+    const uint8_t* src = &voxels[row * PCS];
+    uint64_t* dst = words + (row * Bits);
+    if (UniformRow(src)) {
+      std::fill_n(dst, Bits, index[src[0]] * Repeat);
+      continue;
+    }
+    for (int w = 0; w < Bits; w++) {
+      uint64_t word = 0;
+      for (int i = 0; i < PerWord; i++) {
+        word |= uint64_t{index[src[(w * PerWord) + i]]} << (i * Bits);
+      }
+      dst[w] = word;
+    }
+  }
+}
+
+// Every packed byte expands through two 256 entry tables built from the palette: its voxels'
+// materials as one integer store and their solid bits for the mask column.
+template <int Bits>
+void UnpackRows(const uint64_t* words, std::span<const uint8_t> palette, PaddedChunkGrid3D& grid) {
+  constexpr int PerByte = 8 / Bits;
+  using Run = std::conditional_t<
+      PerByte == 8, uint64_t,
+      std::conditional_t<PerByte == 4, uint32_t,
+                         std::conditional_t<PerByte == 2, uint16_t, uint8_t>>>;
+  static_assert(sizeof(Run) == PerByte);
+  std::array<Run, 256> materials;
+  std::array<uint8_t, 256> solid;
+  for (int b = 0; b < 256; b++) {
+    Run run = 0;
+    uint8_t bits = 0;
+    for (int i = 0; i < PerByte; i++) {
+      const size_t idx = (b >> (i * Bits)) & ((1 << Bits) - 1);
+      const uint8_t mat = idx < palette.size() ? palette[idx] : 0;
+      run |= static_cast<Run>(Run{mat} << (i * 8));
+      bits |= static_cast<uint8_t>((mat != 0) << i);
+    }
+    materials[b] = run;
+    solid[b] = bits;
+  }
+
+  auto& voxels = grid.grid.grid;
+  auto& mask = grid.mask.mask;
+  for (int row = 0; row < PCS2; row++) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(words + (row * Bits));
+    uint8_t* dst = &voxels[row * PCS];
+    uint64_t column = 0;
+    for (int j = 0; j < Bits * 8; j++) {
+      memcpy(dst + (j * PerByte), &materials[bytes[j]], PerByte);
+      column |= uint64_t{solid[bytes[j]]} << (j * PerByte);
+    }
+    mask[row] = column;
+  }
+}
+
+}  // namespace
+
+void PaletteChunk::Encode(const PaddedChunkGrid3D& grid) {
+  ZoneScoped;
+  const auto& voxels = grid.grid.grid;
+  std::array<bool, 256> used{};
+  // terrain is mostly long runs, only words differing from the previous one need their bytes
+  uint64_t prev = 0;
+  used[0] = voxels[0] == 0;
+  for (size_t i = 0; i < voxels.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, &voxels[i], sizeof(word));
+    if (word == prev) continue;
+    prev = word;
+    for (size_t j = 0; j < sizeof(uint64_t); j++) used[voxels[i + j]] = true;
+  }
+
+  // sorted, so air is index 0 when present
+  palette_.clear();
+  PaletteIndex index{};
+  for (int m = 0; m < 256; m++) {
+    if (!used[m]) continue;
+    index[m] = static_cast<uint8_t>(palette_.size());
+    palette_.push_back(static_cast<uint8_t>(m));
+  }
+  palette_.shrink_to_fit();
+  const size_t cnt = palette_.size();
+  bits_ = cnt <= 1 ? 0 : cnt <= 2 ? 1 : cnt <= 4 ? 2 : cnt <= 16 ? 4 : 8;
+
+  words_.resize(static_cast<size_t>(PCS2) * bits_);
+  words_.shrink_to_fit();
+  switch (bits_) {
+    case 1:
+      // air and one material, the rows are the mask columns
+      if (palette_[0] == 0) {
+        memcpy(words_.data(), grid.mask.mask.data(), sizeof(grid.mask.mask));
+      } else {
+        PackRows<1>(voxels, index, words_.data());
+      }
+      break;
+    case 2:
+      PackRows<2>(voxels, index, words_.data());
+      break;
+    case 4:
+      PackRows<4>(voxels, index, words_.data());
+      break;
+    case 8:
+      PackRows<8>(voxels, index, words_.data());
+      break;
+    default:
+      break;
+  }
+}
+
+void PaletteChunk::Decode(PaddedChunkGrid3D& grid) const {
+  ZoneScoped;
+  switch (bits_) {
+    case 1:
+      UnpackRows<1>(words_.data(), palette_, grid);
+      break;
+    case 2:
+      UnpackRows<2>(words_.data(), palette_, grid);
+      break;
+    case 4:
+      UnpackRows<4>(words_.data(), palette_, grid);
+      break;
+    case 8:
+      UnpackRows<8>(words_.data(), palette_, grid);
+      break;
+    default: {
+      const uint8_t mat = palette_.empty() ? 0 : palette_[0];
+      memset(grid.grid.grid.data(), mat, sizeof(grid.grid.grid));
+      memset(grid.mask.mask.data(), mat ? 0xff : 0, sizeof(grid.mask.mask));
+      break;
+    }
+  }
+}
+
+uint8_t PaletteChunk::Get(int x, int y, int z) const {
+  if (bits_ == 0) return palette_.empty() ? 0 : palette_[0];
+  const int bit = z * bits_;
+  const uint64_t word = words_[(((PCS * y) + x) * bits_) + (bit / 64)];
+  return palette_[(word >> (bit % 64)) & ((1u << bits_) - 1)];
+}
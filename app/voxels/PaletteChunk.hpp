@@ -0,0 +1,39 @@
+#pragma once
+
+#include <span>
+
+#include "voxels/Chunk.hpp"
+
+// Voxels of a padded chunk kept resident at a fraction of a PaddedChunkGrid3D: the distinct
+// materials in a sorted palette and every voxel as an index into it, packed at 0, 1, 2, 4 or 8
+// bits. A row of PCS voxels along z packs into exactly bits words, rows in the grid's ZXY order,
+// so row (x, y) is both words [((PCS * y) + x) * bits, +bits) and mask column (PCS * y) + x. Air
+// sorts first, so a 1 bit air and material chunk stores its mask columns as is.
+//
+// Bytes per chunk: 0 bits ~ the palette, 1 bit 32 KiB, 2 bits 64 KiB, 4 bits 128 KiB and 8 bits
+// 256 KiB, against ~290 KiB for the grid and mask. A default constructed chunk is all air.
+class PaletteChunk {
+ public:
+  PaletteChunk() = default;
+  // A chunk of one material, nothing packed
+  explicit PaletteChunk(uint8_t material) {
+    if (material) palette_.push_back(material);
+  }
+
+  void Encode(const PaddedChunkGrid3D& grid);
+  // Writes every voxel and mask column of grid, no clear needed.
+  void Decode(PaddedChunkGrid3D& grid) const;
+  [[nodiscard]] uint8_t Get(int x, int y, int z) const;
+
+  [[nodiscard]] int BitsPerVoxel() const { return bits_; }
+  [[nodiscard]] std::span<const uint8_t> Palette() const { return palette_; }
+  [[nodiscard]] bool IsAir() const { return palette_.empty() || palette_.back() == 0; }
+  [[nodiscard]] size_t MemoryUsage() const {
+    return sizeof(*this) + palette_.capacity() + (words_.capacity() * sizeof(uint64_t));
+  }
+
+ private:
+  std::vector<uint8_t> palette_;
+  std::vector<uint64_t> words_;
+  int bits_{};
+};
@@ -0,0 +1,372 @@
+#include "RegionStore.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include "fmt/format.h"
+#include "voxels/ColumnCodec.hpp"
+
+namespace {
+
+constexpr uint32_t RegionFileMagic = 0x47525856;  // "VXRG"
+constexpr uint32_t ManifestMagic = 0x4D575856;    // "VXWM"
+constexpr uint32_t RegionFormatVersion = 3;
+// quads are stored raw, a build with a different quad layout can't read them
+constexpr uint32_t QuadBytes = sizeof(QuadWord) * QuadWordCount;
+constexpr const char* ManifestName = "world.manifest";
+
+struct RegionHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t quad_bytes;
+  uint32_t chunk_cnt;
+  // which of the two tables is live, switched by appends
+  uint32_t active_table;
+  uint32_t pad;
+};
+
+struct Manifest {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t generator_version;
+  uint32_t region_len;
+  uint64_t settings_hash;
+  int32_t seed;
+  uint32_t pad;
+};
+
+struct MeshHeader {
+  std::array<int32_t, 6> face_vertex_lengths;
+  uint32_t quad_cnt;
+};
+
+int FloorDiv(int v, int d) { return (v >= 0 ? v : v - d + 1) / d; }
+
+// Writes bytes next to path, returns the temporary file's path or an empty one on failure.
+std::filesystem::path WriteTemp(const std::filesystem::path& path, std::span<const uint8_t> bytes) {
+  auto tmp_path = path;
+  tmp_path += fmt::format(".tmp{}", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(bytes.data()),
+             static_cast<std::streamsize>(bytes.size()));
+  if (!file) return {};
+  return tmp_path;
+}
+
+bool RenameOver(const std::filesystem::path& tmp_path, const std::filesystem::path& path) {
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  return true;
+}
+
+bool WriteAtomically(const std::filesystem::path& path, std::span<const uint8_t> bytes) {
+  const auto tmp_path = WriteTemp(path, bytes);
+  return !tmp_path.empty() && RenameOver(tmp_path, path);
+}
+
+template <typename T>
+void Append(std::vector<uint8_t>& out, const T* data, size_t cnt) {
+  const size_t off = out.size();
+  out.resize(off + (sizeof(T) * cnt));
+  memcpy(out.data() + off, data, sizeof(T) * cnt);
+}
+
+using RegionTable = std::array<RegionTableEntry, RegionChunks>;
+constexpr size_t RegionTableOffset(uint32_t table) {
+  return sizeof(RegionHeader) + (table * sizeof(RegionTable));
+}
+constexpr size_t RegionBlobsOffset = RegionTableOffset(2);
+
+// Room for the header and tables at the front of out, filled in by FinishRegion once the blobs
+// after them are placed.
+void BeginRegion(std::vector<uint8_t>& out) { out.assign(RegionBlobsOffset, 0); }
+
+void FinishRegion(std::vector<uint8_t>& out, const RegionTable& table) {
+  const RegionHeader header{.magic = RegionFileMagic,
+                            .version = RegionFormatVersion,
+                            .quad_bytes = QuadBytes,
+                            .chunk_cnt = RegionChunks,
+                            .active_table = 0,
+                            .pad = 0};
+  memcpy(out.data(), &header, sizeof(header));
+  memcpy(out.data() + RegionTableOffset(0), table.data(), sizeof(table));
+}
+
+// Appends the chunk's voxels and mesh to out, whose first byte goes at file offset base.
+RegionTableEntry AppendChunk(std::vector<uint8_t>& out, uint64_t base,
+                             const RegionChunkData& chunk) {
+  RegionTableEntry entry{.offset = base + out.size(),
+                         .voxel_size = static_cast<uint32_t>(chunk.voxels.size()),
+                         .mesh_size = 0};
+  const size_t start = out.size();
+  Append(out, chunk.voxels.data(), chunk.voxels.size());
+  MeshHeader mesh{};
+  std::ranges::copy(chunk.face_vertex_lengths, mesh.face_vertex_lengths.begin());
+  mesh.quad_cnt = static_cast<uint32_t>(chunk.quads.size() / QuadWordCount);
+  Append(out, &mesh, 1);
+  Append(out, chunk.quads.data(), chunk.quads.size());
+  entry.mesh_size = static_cast<uint32_t>(out.size() - start - entry.voxel_size);
+  return entry;
+}
+
+}  // namespace
+
+ivec3 RegionOf(ivec3 chunk_pos) {
+  return {FloorDiv(chunk_pos.x, RegionLen), FloorDiv(chunk_pos.y, RegionLen),
+          FloorDiv(chunk_pos.z, RegionLen)};
+}
+
+int RegionChunkIndex(ivec3 chunk_pos) {
+  const ivec3 local = chunk_pos - (RegionOf(chunk_pos) * RegionLen);
+  return (((local.y * RegionLen) + local.x) * RegionLen) + local.z;
+}
+
+std::filesystem::path RegionPath(const std::filesystem::path& dir, ivec3 region, int lod) {
+  return dir / fmt::format("r{}_{}_{}_{}.region", lod, region.x, region.y, region.z);
+}
+
+std::filesystem::path RegionManifestPath(const std::filesystem::path& dir) {
+  return dir / ManifestName;
+}
+
+bool WriteRegion(const std::filesystem::path& path,
+                 std::span<const RegionChunkData, RegionChunks> chunks) {
+  ZoneScoped;
+  RegionTable table{};
+  std::vector<uint8_t> out;
+  BeginRegion(out);
+  for (int i = 0; i < RegionChunks; i++) {
+    if (chunks[i].voxels.empty()) continue;
+    table[i] = AppendChunk(out, 0, chunks[i]);
+  }
+  FinishRegion(out, table);
+  return WriteAtomically(path, out);
+}
+
+bool WriteRegionManifest(const std::filesystem::path& dir, uint32_t generator_version,
+                         uint64_t settings_hash, int seed) {
+  const Manifest manifest{.magic = ManifestMagic,
+                          .version = RegionFormatVersion,
+                          .generator_version = generator_version,
+                          .region_len = RegionLen,
+                          .settings_hash = settings_hash,
+                          .seed = seed,
+                          .pad = 0};
+  return WriteAtomically(RegionManifestPath(dir),
+                         {reinterpret_cast<const uint8_t*>(&manifest), sizeof(manifest)});
+}
+
+bool RegionStore::Open(const std::filesystem::path& dir, uint32_t generator_version,
+                       uint64_t settings_hash, int seed) {
+  Close();
+  Manifest manifest{};
+  std::ifstream file(RegionManifestPath(dir), std::ios::binary);
+  file.read(reinterpret_cast<char*>(&manifest), sizeof(manifest));
+  if (!file) {
+    fmt::println("region store: no manifest in {}", dir.string());
+    return false;
+  }
+  if (manifest.magic != ManifestMagic || manifest.version != RegionFormatVersion ||
+      manifest.region_len != RegionLen || manifest.generator_version != generator_version ||
+      manifest.settings_hash != settings_hash || manifest.seed != seed) {
+    fmt::println("region store: {} was generated with different settings, ignoring it",
+                 dir.string());
+    return false;
+  }
+  dir_ = dir;
+  return true;
+}
+
+void RegionStore::Close() {
+  std::lock_guard lock(mtx_);
+  dir_.clear();
+  regions_.clear();
+}
+
+std::span<const uint8_t> RegionStore::Region::Blob(uint64_t offset, uint64_t size) const {
+  const auto bytes = file.Bytes();
+  if (offset > bytes.size() || size > bytes.size() - offset) return {};
+  return bytes.subspan(offset, size);
+}
+
+RegionStore::RegionPtr RegionStore::MapRegion(const std::filesystem::path& path) {
+  ZoneScoped;
+  auto region = std::make_shared<Region>();
+  if (!region->file.Open(path)) return region;
+  const auto bytes = region->file.Bytes();
+  RegionHeader header{};
+  if (bytes.size() >= RegionBlobsOffset) memcpy(&header, bytes.data(), sizeof(header));
+  if (header.magic != RegionFileMagic || header.version != RegionFormatVersion ||
+      header.quad_bytes != QuadBytes || header.chunk_cnt != RegionChunks ||
+      header.active_table > 1) {
+    region->file.Close();
+    return region;
+  }
+  region->active_table = header.active_table;
+  region->table.resize(RegionChunks);
+  memcpy(region->table.data(), bytes.data() + RegionTableOffset(header.active_table),
+         sizeof(RegionTable));
+  uint64_t live_bytes = RegionBlobsOffset;
+  for (const auto& entry : region->table) live_bytes += entry.voxel_size + entry.mesh_size;
+  region->dead_bytes = bytes.size() > live_bytes ? bytes.size() - live_bytes : 0;
+  return region;
+}
+
+RegionStore::RegionPtr RegionStore::GetRegion(ivec3 region, int lod) const {
+  std::lock_guard lock(mtx_);
+  auto& entry = regions_[ivec4{region, lod}];
+  if (!entry) entry = MapRegion(RegionPath(dir_, region, lod));
+  return entry;
+}
+
+RegionStore::RegionPtr RegionStore::ReloadRegion(ivec3 region, int lod) {
+  auto mapped = MapRegion(RegionPath(dir_, region, lod));
+  std::lock_guard lock(mtx_);
+  regions_[ivec4{region, lod}] = mapped;
+  return mapped;
+}
+
+bool RegionStore::LoadChunk(ivec3 pos, int lod, PaddedChunkGrid3D& grid) const {
+  ZoneScoped;
+  if (!IsOpen()) return false;
+  const RegionPtr region = GetRegion(RegionOf(pos), lod);
+  if (region->table.empty()) return false;
+  const auto& entry = region->table[RegionChunkIndex(pos)];
+  if (!entry.voxel_size) return false;
+  const auto blob = region->Blob(entry.offset, entry.voxel_size);
+  if (blob.empty() || !DecodeChunkColumns(blob, grid)) {
+    grid.Clear();
+    return false;
+  }
+  return true;
+}
+
+bool RegionStore::LoadMesh(ivec3 pos, int lod, MeshSink& sink,
+                           std::array<int, 6>& face_vertex_lengths) const {
+  ZoneScoped;
+  if (!IsOpen()) return false;
+  const RegionPtr region = GetRegion(RegionOf(pos), lod);
+  if (region->table.empty()) return false;
+  const auto& entry = region->table[RegionChunkIndex(pos)];
+  if (entry.mesh_size < sizeof(MeshHeader)) return false;
+  const auto blob = region->Blob(entry.offset + entry.voxel_size, entry.mesh_size);
+  if (blob.empty()) return false;
+  MeshHeader mesh;
+  memcpy(&mesh, blob.data(), sizeof(mesh));
+  if (blob.size() - sizeof(mesh) != static_cast<size_t>(mesh.quad_cnt) * QuadBytes) return false;
+  std::ranges::copy(mesh.face_vertex_lengths, face_vertex_lengths.begin());
+  QuadWord* dst = sink.Reserve(mesh.quad_cnt);
+  if (mesh.quad_cnt) {
+    memcpy(dst, blob.data() + sizeof(mesh), static_cast<size_t>(mesh.quad_cnt) * QuadBytes);
+  }
+  sink.Commit(mesh.quad_cnt);
+  return true;
+}
+
+bool RegionStore::StoreChunks(ivec3 region, int lod,
+                              std::span<const RegionChunkData, RegionChunks> chunks) {
+  std::vector<IndexedChunk> indexed;
+  for (int i = 0; i < RegionChunks; i++) {
+    if (!chunks[i].voxels.empty()) indexed.emplace_back(i, &chunks[i]);
+  }
+  return Append(region, lod, indexed);
+}
+
+bool RegionStore::Append(ivec3 region, int lod, std::span<const IndexedChunk> chunks) {
+  ZoneScoped;
+  if (!IsOpen()) return false;
+  std::lock_guard write_lock(write_mtx_);
+  const auto path = RegionPath(dir_, region, lod);
+  RegionPtr current = GetRegion(region, lod);
+  RegionTable table{};
+  std::vector<uint8_t> out;
+  bool ok;
+  if (current->table.empty()) {
+    // missing or unreadable, nothing worth keeping
+    BeginRegion(out);
+    for (const auto& [i, chunk] : chunks) table[i] = AppendChunk(out, 0, *chunk);
+    FinishRegion(out, table);
+    ok = WriteAtomically(path, out);
+  } else {
+    // Blobs go past the end of the file, so loads holding the current mapping never see them.
+    // Once they're in place the new table goes to the slot not in use, and a 4 byte header write
+    // switches to it, so a crash or short write leaves the previous table whole.
+    std::ranges::copy(current->table, table.begin());
+    const uint64_t base = current->file.Bytes().size();
+    const uint32_t next_table = current->active_table ^ 1;
+    for (const auto& [i, chunk] : chunks) table[i] = AppendChunk(out, base, *chunk);
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(base));
+    file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+    file.flush();
+    if (file) {
+      file.seekp(static_cast<std::streamoff>(RegionTableOffset(next_table)));
+      file.write(reinterpret_cast<const char*>(table.data()), sizeof(table));
+      file.flush();
+    }
+    if (file) {
+      file.seekp(static_cast<std::streamoff>(offsetof(RegionHeader, active_table)));
+      file.write(reinterpret_cast<const char*>(&next_table), sizeof(next_table));
+      file.flush();
+    }
+    ok = static_cast<bool>(file);
+  }
+  current.reset();
+  RegionPtr updated = ReloadRegion(region, lod);
+  if (!ok) return false;
+  const uint64_t size = updated->file.Bytes().size();
+  if (updated->dead_bytes > size - updated->dead_bytes) {
+    return Compact(region, lod, std::move(updated));
+  }
+  return true;
+}
+
+bool RegionStore::Compact(ivec3 region, int lod, RegionPtr current) {
+  ZoneScoped;
+  RegionTable table{};
+  std::vector<uint8_t> out;
+  BeginRegion(out);
+  for (int i = 0; i < RegionChunks; i++) {
+    const auto& entry = current->table[i];
+    if (!entry.voxel_size) continue;
+    const auto blob = current->Blob(entry.offset, uint64_t{entry.voxel_size} + entry.mesh_size);
+    if (blob.empty()) continue;
+    table[i] = {.offset = out.size(), .voxel_size = entry.voxel_size, .mesh_size = entry.mesh_size};
+    out.insert(out.end(), blob.begin(), blob.end());
+  }
+  FinishRegion(out, table);
+  current.reset();
+  const bool ok = ReplaceRegionFile(region, lod, out);
+  ReloadRegion(region, lod);
+  return ok;
+}
+
+bool RegionStore::ReplaceRegionFile(ivec3 region, int lod, std::span<const uint8_t> bytes) {
+  const auto path = RegionPath(dir_, region, lod);
+#ifdef _WIN32
+  // Windows can't replace a file that is still mapped. The cached mapping is dropped and new loads
+  // wait on mtx_ until the file is replaced, loads still reading an older mapping are done within
+  // a chunk decode, so the rename is retried until they are.
+  const auto tmp_path = WriteTemp(path, bytes);
+  if (tmp_path.empty()) return false;
+  std::lock_guard lock(mtx_);
+  regions_.erase(ivec4{region, lod});
+  std::error_code ec;
+  for (int attempt = 0; attempt < 1000; attempt++) {
+    std::filesystem::rename(tmp_path, path, ec);
+    if (!ec) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::filesystem::remove(tmp_path, ec);
+  return false;
+#else
+  return WriteAtomically(path, bytes);
+#endif
+}
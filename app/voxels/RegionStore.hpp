@@ -0,0 +1,105 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <span>
+
+#include "MappedFile.hpp"
+#include "voxels/Chunk.hpp"
+#include "voxels/Mesher.hpp"
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+// Pre-generated world written by voxel_pregen. Chunks are grouped into regions of RegionLen^3
+// chunks per lod, one file per region: a header, two tables with the blob offset and sizes of
+// every chunk, the header naming the live one, then per chunk its voxels encoded by
+// EncodeChunkColumns followed by its mesh. A manifest in the directory records the generator
+// version, settings hash and seed the world was made with, so a world from different settings is
+// rejected as a whole instead of mixing terrain. Chunks stored into an existing region are
+// appended and the other table pointed at them before it's made live, leaving the old blobs as
+// dead bytes until the region is compacted.
+constexpr int RegionLen = 8;
+constexpr int RegionChunks = RegionLen * RegionLen * RegionLen;
+
+struct RegionChunkData {
+  // empty if the chunk wasn't generated
+  std::vector<uint8_t> voxels;
+  std::array<int, 6> face_vertex_lengths{};
+  std::vector<QuadWord> quads;
+};
+
+// Location of a chunk's blobs in its region file, voxel_size 0 if the chunk is absent. The mesh
+// follows the voxels.
+struct RegionTableEntry {
+  uint64_t offset;
+  uint32_t voxel_size;
+  uint32_t mesh_size;
+};
+
+ivec3 RegionOf(ivec3 chunk_pos);
+// Index of the chunk in its region's table.
+int RegionChunkIndex(ivec3 chunk_pos);
+std::filesystem::path RegionPath(const std::filesystem::path& dir, ivec3 region, int lod);
+std::filesystem::path RegionManifestPath(const std::filesystem::path& dir);
+
+// Writes a whole region, chunks indexed by RegionChunkIndex. Written to a temporary name and
+// renamed, so readers never see a partial region.
+[[nodiscard]] bool WriteRegion(const std::filesystem::path& path,
+                               std::span<const RegionChunkData, RegionChunks> chunks);
+[[nodiscard]] bool WriteRegionManifest(const std::filesystem::path& dir, uint32_t generator_version,
+                                       uint64_t settings_hash, int seed);
+
+// Region files memory mapped, so a chunk load is a page fault and a decode out of the mapping. Each
+// region's table is copied once when it's mapped. Loads are safe to call from worker threads
+// between Open and Close, also while chunks are being stored: a load keeps using the snapshot of
+// the region it started with, whose blobs appends never modify and compaction writes to a new
+// file.
+class RegionStore {
+ public:
+  // Fails if the directory has no manifest or it doesn't match the arguments.
+  bool Open(const std::filesystem::path& dir, uint32_t generator_version, uint64_t settings_hash,
+            int seed);
+  void Close();
+  [[nodiscard]] bool IsOpen() const { return !dir_.empty(); }
+  // False if the chunk isn't stored or its blob is corrupt, grid is cleared for the latter.
+  [[nodiscard]] bool LoadChunk(ivec3 pos, int lod, PaddedChunkGrid3D& grid) const;
+  // Writes the stored mesh through sink, Reserve and Commit are called even for an empty mesh.
+  // Nothing is written to sink on failure.
+  [[nodiscard]] bool LoadMesh(ivec3 pos, int lod, MeshSink& sink,
+                              std::array<int, 6>& face_vertex_lengths) const;
+
+  // Appends the chunks of a region to its file, indexed by RegionChunkIndex, creating the file if
+  // it's missing or unreadable. Chunks without voxels keep what the region has stored for them.
+  // Compacts the region once its dead bytes outweigh the live ones.
+  bool StoreChunks(ivec3 region, int lod, std::span<const RegionChunkData, RegionChunks> chunks);
+
+ private:
+  struct Region {
+    MappedFile file;
+    // copied out of the mapping, empty if the region file is missing or unreadable
+    std::vector<RegionTableEntry> table;
+    // the header's active table, the other is where the next append writes
+    uint32_t active_table{};
+    uint64_t dead_bytes{};
+    // Bytes at [offset, offset + size) of the mapping, empty if they're past its end
+    [[nodiscard]] std::span<const uint8_t> Blob(uint64_t offset, uint64_t size) const;
+  };
+  using RegionPtr = std::shared_ptr<const Region>;
+  using IndexedChunk = std::pair<int, const RegionChunkData*>;
+  static RegionPtr MapRegion(const std::filesystem::path& path);
+  RegionPtr GetRegion(ivec3 region, int lod) const;
+  // Maps the region file again, after a write replaced or appended to it.
+  RegionPtr ReloadRegion(ivec3 region, int lod);
+  bool Append(ivec3 region, int lod, std::span<const IndexedChunk> chunks);
+  // Rewrites the region with only the live blobs of current, which should be the only snapshot of
+  // the region the caller holds.
+  bool Compact(ivec3 region, int lod, RegionPtr current);
+  bool ReplaceRegionFile(ivec3 region, int lod, std::span<const uint8_t> bytes);
+
+  std::filesystem::path dir_;
+  mutable std::mutex mtx_;
+  // serializes the write side, loads never wait on it
+  std::mutex write_mtx_;
+  // keyed by (region, lod). Writes replace entries, loads hold on to the one they got.
+  mutable std::unordered_map<ivec4, RegionPtr> regions_;
+};
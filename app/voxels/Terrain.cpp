@@ -1,5 +1,12 @@
 #include "Terrain.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "CpuFeatures.hpp"
 #include "FastNoise/FastNoise.h"
 
 namespace gen {
@@ -18,30 +25,124 @@ void FBMNoise::InitNoise() {
   fbm->SetSource(fn_simplex);
   fbm->SetOctaveCount(octaves_);
   white_noise = FastNoise::New<FastNoise::White>();
+  fbm_by_octaves_.resize(octaves_);
+  for (int i = 0; i < octaves_; i++) {
+    fbm_by_octaves_[i] = FastNoise::New<FastNoise::FractalFBm>();
+    fbm_by_octaves_[i]->SetSource(fn_simplex);
+    fbm_by_octaves_[i]->SetOctaveCount(i + 1);
+  }
+}
+
+int FBMNoise::NyquistOctaves(float sample_frequency) const {
+  // octave i has frequency sample_frequency * 2^i, keep it while that's below half a cycle per
+  // sample
+  int octaves = 1;
+  float f = sample_frequency * 2;
+  while (octaves < octaves_ && f < 0.5f) {
+    octaves++;
+    f *= 2;
+  }
+  return octaves;
+}
+
+void FBMNoise::FillNoise2DBandLimited(std::span<float> out, ivec2 start, uvec2 dims,
+                                      float sample_frequency) const {
+  ZoneScoped;
+  EASSERT(out.size() >= static_cast<size_t>(dims.x) * dims.y);
+  const int octaves = NyquistOctaves(sample_frequency);
+  if (octaves == octaves_) {
+    fbm->GenUniformGrid2D(out.data(), start.x, start.y, dims.x, dims.y, sample_frequency, seed_);
+    return;
+  }
+  fbm_by_octaves_[octaves - 1]->GenUniformGrid2D(out.data(), start.x, start.y, dims.x, dims.y,
+                                                 sample_frequency, seed_);
+  // FBm normalizes by the summed octave amplitudes, 1 + gain + gain^2 ..., with the default gain
+  // of 0.5. Rescale from the kept octaves' sum to the full sum.
+  constexpr float Gain = 0.5f;
+  const float scale = (1.f - std::pow(Gain, static_cast<float>(octaves))) /
+                      (1.f - std::pow(Gain, static_cast<float>(octaves_)));
+  const size_t cnt = static_cast<size_t>(dims.x) * dims.y;
+  for (size_t i = 0; i < cnt; i++) {
+    out[i] *= scale;
+  }
 }
 
 void FBMNoise::GetNoise(std::span<float> out, uvec2 start, uvec2 size) const {
   fbm->GenUniformGrid2D(out.data(), start.x, start.y, size.x, size.y, frequency_, seed_);
 }
 
-void NoiseToHeights(std::span<float> noise, HeightMapData& data, uvec2 range) {
-  ZoneScoped;
-  uint32_t span = range.y - range.x;
-  data.range.x = std::numeric_limits<int>::max();
-  data.range.y = std::numeric_limits<int>::lowest();
-  for (size_t i = 0; i < noise.size(); i++) {
-    int h = std::floor(((noise[i] + 1.0) * 0.5 * span) + range.x);
-    data.heights[i] = h;
-    data.range.x = std::min(data.range.x, h);
-    data.range.y = std::max(data.range.y, h);
+namespace {
+
+inline int NoiseToHeight(float noise, uvec2 range) {
+  const double h = std::floor(((noise + 1.0) * 0.5 * (range.y - range.x)) + range.x);
+  return static_cast<int>(std::clamp<double>(h, range.x, range.y));
+}
+
+ivec2 NoiseToHeightsScalar(const float* noise, int* heights, size_t cnt, uvec2 range) {
+  ivec2 minmax{std::numeric_limits<int>::max(), std::numeric_limits<int>::lowest()};
+  for (size_t i = 0; i < cnt; i++) {
+    const int h = NoiseToHeight(noise[i], range);
+    heights[i] = h;
+    minmax.x = std::min(minmax.x, h);
+    minmax.y = std::max(minmax.y, h);
+  }
+  return minmax;
+}
+
+#ifdef CPU_X86_64
+// Same arithmetic as NoiseToHeight, widened to double 4 lanes at a time. No FMA, contracting the
+// multiply and add would round differently from the scalar path.
+TARGET_AVX2 inline __m128i NoiseToHeights4(__m128 noise, __m256d span, __m256d lo, __m256d hi) {
+  __m256d h = _mm256_add_pd(_mm256_cvtps_pd(noise), _mm256_set1_pd(1.0));
+  h = _mm256_mul_pd(_mm256_mul_pd(h, _mm256_set1_pd(0.5)), span);
+  h = _mm256_floor_pd(_mm256_add_pd(h, lo));
+  return _mm256_cvttpd_epi32(_mm256_max_pd(_mm256_min_pd(h, hi), lo));
+}
+
+TARGET_AVX2 ivec2 NoiseToHeightsAVX2(const float* noise, int* heights, size_t cnt, uvec2 range) {
+  const __m256d span = _mm256_set1_pd(static_cast<double>(range.y - range.x));
+  const __m256d lo = _mm256_set1_pd(static_cast<double>(range.x));
+  const __m256d hi = _mm256_set1_pd(static_cast<double>(range.y));
+  __m256i min_h = _mm256_set1_epi32(std::numeric_limits<int>::max());
+  __m256i max_h = _mm256_set1_epi32(std::numeric_limits<int>::lowest());
+  size_t i = 0;
+  for (; i + 8 <= cnt; i += 8) {
+    const __m256 n = _mm256_loadu_ps(noise + i);
+    const __m256i h =
+        _mm256_set_m128i(NoiseToHeights4(_mm256_extractf128_ps(n, 1), span, lo, hi),
+                         NoiseToHeights4(_mm256_castps256_ps128(n), span, lo, hi));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(heights + i), h);
+    min_h = _mm256_min_epi32(min_h, h);
+    max_h = _mm256_max_epi32(max_h, h);
   }
+  alignas(32) std::array<int, 8> min_lanes;
+  alignas(32) std::array<int, 8> max_lanes;
+  _mm256_store_si256(reinterpret_cast<__m256i*>(min_lanes.data()), min_h);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(max_lanes.data()), max_h);
+  ivec2 minmax = NoiseToHeightsScalar(noise + i, heights + i, cnt - i, range);
+  for (int lane = 0; lane < 8; lane++) {
+    minmax.x = std::min(minmax.x, min_lanes[lane]);
+    minmax.y = std::max(minmax.y, max_lanes[lane]);
+  }
+  return minmax;
 }
+#endif
+
+}  // namespace
 
-void NoiseToHeights(std::span<float> noise, std::span<int> heights, uvec2 range) {
-  uint32_t span = range.y - range.x;
-  for (size_t i = 0; i < noise.size(); i++) {
-    heights[i] = std::floor(((noise[i] + 1.0) * 0.5 * span) + range.x);
+ivec2 NoiseToHeights(std::span<const float> noise, std::span<int> heights, uvec2 range) {
+  ZoneScoped;
+  EASSERT(heights.size() >= noise.size());
+#ifdef CPU_X86_64
+  if (cpu::HasAVX2()) {
+    return NoiseToHeightsAVX2(noise.data(), heights.data(), noise.size(), range);
   }
+#endif
+  return NoiseToHeightsScalar(noise.data(), heights.data(), noise.size(), range);
+}
+
+void NoiseToHeights(std::span<const float> noise, HeightMapData& data, uvec2 range) {
+  data.range = NoiseToHeights(noise, data.heights, range);
 }
 
 void FillChunk(PaddedChunkGrid3D& grid, std::span<int> heights, int value) {
@@ -58,12 +159,140 @@ void FillChunk(PaddedChunkGrid3D& grid, std::span<int> heights, int value) {
   }
 }
 
+void FillChunkColumns(PaddedChunkGrid3D& grid, std::span<const int> heights, int y_start,
+                      int y_scale, uint8_t material, int first, int last) {
+  ZoneScoped;
+  // Solid layer count of each column
+  HeightMapGrid<PCS> layers;
+  for (int i = 0; i < PCS2; i++) {
+    const int above = heights[i] - y_start;
+    layers[i] = above <= 0 ? 0 : (above + y_scale - 1) / y_scale;
+  }
+  grid.FillColumns(layers, material, first, last);
+}
+
 void FillSolid(PaddedChunkGrid3D& grid, int value) {
-  // TODO: optimize, this is awful
-  for (int y = 0; y < PaddedChunkGrid3D::Dims.x; y++) {
-    for (int x = 0; x < PaddedChunkGrid3D::Dims.y; x++) {
-      for (int z = 0; z < PaddedChunkGrid3D::Dims.z; z++) {
-        grid.Set(x, y, z, value);
+  grid.FillBox(ivec3{0}, ivec3{PCS}, value);
+}
+
+void DensityNoise::Init(int seed) {
+  seed_ = seed;
+  surface_ = FastNoise::New<FastNoise::FractalFBm>();
+  surface_->SetSource(FastNoise::New<FastNoise::Simplex>());
+  surface_->SetOctaveCount(3);
+  cave_ = FastNoise::New<FastNoise::FractalFBm>();
+  cave_->SetSource(FastNoise::New<FastNoise::Simplex>());
+  cave_->SetOctaveCount(2);
+}
+
+namespace {
+int FloorDiv(int v, int d) { return (v >= 0 ? v : v - d + 1) / d; }
+}  // namespace
+
+// Noise is generated with the axes permuted, noise x/y/z = world z/x/y, so the output is in ZXY
+// order like the voxel grid.
+bool DensityNoise::SampleCaves(ivec3 chunk_start, int first, int last,
+                               CaveSamples& samples) const {
+  ZoneScoped;
+  const ivec3 lo = chunk_start + first;
+  const ivec3 hi = chunk_start + last;
+  samples.min = {FloorDiv(lo.x, CaveStep), FloorDiv(lo.y, CaveStep), FloorDiv(lo.z, CaveStep)};
+  samples.dims = ivec3{FloorDiv(hi.x, CaveStep), FloorDiv(hi.y, CaveStep),
+                       FloorDiv(hi.z, CaveStep)} - samples.min + 2;
+  const int cnt = samples.dims.x * samples.dims.y * samples.dims.z;
+  cave_->GenUniformGrid3D(samples.values.data(), samples.min.z, samples.min.x, samples.min.y,
+                          samples.dims.z, samples.dims.x, samples.dims.y,
+                          cave_frequency * CaveStep, seed_ + 1);
+  return *std::max_element(samples.values.begin(), samples.values.begin() + cnt) >=
+         cave_threshold;
+}
+
+void DensityNoise::FillChunk(PaddedChunkGrid3D& grid, ivec3 chunk_start,
+                             const HeightMapData& height_map, uint8_t material, int first,
+                             int last) const {
+  ZoneScoped;
+  if (material == 0) return;
+  const auto y_low = static_cast<float>(chunk_start.y + first);
+  const auto y_high = static_cast<float>(chunk_start.y + last);
+  if (y_low >= static_cast<float>(height_map.range.y) + surface_falloff) {
+    return;
+  }
+  const bool below_surface = y_high < static_cast<float>(height_map.range.x) - surface_falloff;
+  CaveSamples samples;
+  const bool caves = SampleCaves(chunk_start, first, last, samples);
+  if (below_surface && !caves) {
+    grid.FillBox(ivec3{first}, ivec3{last + 1}, material);
+    return;
+  }
+
+  thread_local std::vector<float> surface_noise;
+  if (!below_surface) {
+    surface_noise.resize(PCS3);
+    surface_->GenUniformGrid3D(surface_noise.data(), chunk_start.z, chunk_start.x, chunk_start.y,
+                               PCS, PCS, PCS, surface_frequency, seed_);
+  }
+  // Sample to the left of each voxel and the voxel's weight towards the next one, per axis.
+  // std::lerp is monotonic and exact at both ends, so interpolated values never leave the range
+  // of the samples and SampleCaves' answer holds for every voxel.
+  std::array<int, PCS> sample_x;
+  std::array<int, PCS> sample_z;
+  std::array<float, PCS> t_x;
+  std::array<float, PCS> t_z;
+  for (int i = first; i <= last; i++) {
+    const int wx = chunk_start.x + i;
+    const int wz = chunk_start.z + i;
+    sample_x[i] = FloorDiv(wx, CaveStep) - samples.min.x;
+    sample_z[i] = FloorDiv(wz, CaveStep) - samples.min.z;
+    t_x[i] = static_cast<float>(wx - ((sample_x[i] + samples.min.x) * CaveStep)) / CaveStep;
+    t_z[i] = static_cast<float>(wz - ((sample_z[i] + samples.min.z) * CaveStep)) / CaveStep;
+  }
+  const int sample_row = samples.dims.z;
+  const int sample_layer = samples.dims.x * samples.dims.z;
+  // Cave noise along z at the sample points, interpolated to the current x and y
+  std::array<float, CaveSamples::MaxDims> cave_row;
+
+  const int len = last - first + 1;
+  const uint64_t range_bits = len == PCS ? ~0ull : ((1ull << len) - 1) << first;
+  auto& mask = grid.mask.mask;
+  auto& voxels = grid.grid.grid;
+  for (int y = first; y <= last; y++) {
+    const int wy = chunk_start.y + y;
+    const auto world_y = static_cast<float>(wy);
+    const int sample_y = FloorDiv(wy, CaveStep) - samples.min.y;
+    const float t_y = static_cast<float>(wy - ((sample_y + samples.min.y) * CaveStep)) / CaveStep;
+    for (int x = first; x <= last; x++) {
+      const int column = ZXY<PCS>(x, y, 0);
+      if (caves) {
+        const float* s00 = &samples.values[(sample_y * sample_layer) + (sample_x[x] * sample_row)];
+        const float* s01 = s00 + sample_row;
+        const float* s10 = s00 + sample_layer;
+        const float* s11 = s10 + sample_row;
+        for (int i = 0; i < samples.dims.z; i++) {
+          cave_row[i] = std::lerp(std::lerp(s00[i], s01[i], t_x[x]),
+                                  std::lerp(s10[i], s11[i], t_x[x]), t_y);
+        }
+      }
+      uint64_t word = 0;
+      for (int z = first; z <= last; z++) {
+        // Solid below the height map, moved up or down by the surface noise
+        bool solid = below_surface ||
+                     world_y - static_cast<float>(height_map.heights[(z * PCS) + x]) <
+                         surface_noise[column + z] * surface_falloff;
+        if (caves) {
+          solid = solid && std::lerp(cave_row[sample_z[z]], cave_row[sample_z[z] + 1], t_z[z]) <
+                               cave_threshold;
+        }
+        word |= static_cast<uint64_t>(solid) << z;
+      }
+      if (!word) continue;
+      mask[(PCS * y) + x] |= word;
+      uint8_t* run = &voxels[column];
+      if (word == range_bits) {
+        memset(run + first, material, len);
+      } else {
+        for (uint64_t bits = word; bits; bits &= bits - 1) {
+          run[std::countr_zero(bits)] = material;
+        }
       }
     }
   }
@@ -74,30 +303,13 @@ void FBMNoise::GetWhiteNoise(std::span<float> out, uvec2 start, uvec2 size) cons
 }
 
 int GetHeight(std::span<const float> noise, int i, uvec2 range) {
-  return std::floor(((noise[i] + 1.0) * 0.5 * (range.y - range.x)) + range.x);
+  return NoiseToHeight(noise[i], range);
 }
 int GetHeight(std::span<const float> noise, int x, int z, uvec2 range) {
-  return std::floor(((noise[x * PCS + z] + 1.0) * 0.5 * (range.y - range.x)) + range.x);
+  return NoiseToHeight(noise[(x * PCS) + z], range);
 }
 
 void FillVisibleCube(PaddedChunkGrid3D& grid, int gap, int val) {
-  int lower = gap;
-  int upper = PCS - gap;
-  for (int y = lower; y < upper; y++) {
-    for (int z = lower; z < upper; z++) {
-      for (int x = lower; x < upper; x++) {
-        grid.Set(x, y, z, val);
-      }
-    }
-  }
-}
-void FillVisibleCube(PaddedChunkGrid3D& grid, int gap, const std::function<uint8_t()>& func) {
-  for (int y = 1 + gap; y < PCS - 1 - gap; y++) {
-    for (int z = 1 + gap; z < PCS - 1 - gap; z++) {
-      for (int x = 1 + gap; x < PCS - 1 - gap; x++) {
-        grid.Set(x, y, z, func());
-      }
-    }
-  }
+  grid.FillBox(ivec3{gap}, ivec3{PCS - gap}, val);
 }
 }  // namespace gen
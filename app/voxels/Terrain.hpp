@@ -29,11 +29,22 @@ void FillSphereArgs(PaddedChunkGrid3D& grid, Func&& func) {
 }
 void FillVisibleCube(PaddedChunkGrid3D& grid, int gap, int val);
 
-void FillVisibleCube(PaddedChunkGrid3D& grid, int gap, const std::function<uint8_t()>& func);
+template <typename Func>
+void FillVisibleCube(PaddedChunkGrid3D& grid, int gap, Func&& func) {
+  static_assert(std::is_invocable_r_v<uint8_t, Func>, "Func not invocable");
+  for (int y = 1 + gap; y < PCS - 1 - gap; y++) {
+    for (int z = 1 + gap; z < PCS - 1 - gap; z++) {
+      for (int x = 1 + gap; x < PCS - 1 - gap; x++) {
+        grid.Set(x, y, z, func());
+      }
+    }
+  }
+}
 
-template <int Len>
-void FillSphere(PaddedChunkGrid3D& grid, const std::function<uint8_t()>& func) {
-  int r = CS / 2;
+template <int Len, typename Func>
+void FillSphere(BasicPaddedChunkGrid3D<Len>& grid, Func&& func) {
+  static_assert(std::is_invocable_r_v<uint8_t, Func>, "Func not invocable");
+  int r = ChunkDims<Len>::CS / 2;
   for (int y = -r; y < r; y++) {
     for (int x = -r; x < r; x++) {
       for (int z = -r; z < r; z++) {
@@ -47,8 +58,8 @@ void FillSphere(PaddedChunkGrid3D& grid, const std::function<uint8_t()>& func) {
   }
 }
 template <int Len>
-void FillSphere(PaddedChunkGrid3D& grid, uint8_t val) {
-  int r = CS / 2;
+void FillSphere(BasicPaddedChunkGrid3D<Len>& grid, uint8_t val) {
+  int r = ChunkDims<Len>::CS / 2;
   for (int y = -r; y < r; y++) {
     for (int x = -r; x < r; x++) {
       for (int z = -r; z < r; z++) {
@@ -62,8 +73,12 @@ void FillSphere(PaddedChunkGrid3D& grid, uint8_t val) {
   }
 }
 
-void NoiseToHeights(std::span<float> noise, std::span<int> heights, uvec2 range);
-void NoiseToHeights(std::span<float> noise, HeightMapData& data, uvec2 range);
+// Maps noise in [-1, 1] onto range: floor(((n + 1) * 0.5 * (range.y - range.x)) + range.x),
+// evaluated in double like GetHeight so every path yields the same heights. Heights are clamped
+// to range, so callers can bound terrain by it without generating. Vectorized where the CPU
+// allows, tracking the min and max height in the same pass. Returns {min, max}.
+ivec2 NoiseToHeights(std::span<const float> noise, std::span<int> heights, uvec2 range);
+void NoiseToHeights(std::span<const float> noise, HeightMapData& data, uvec2 range);
 
 int GetHeight(std::span<const float> noise, int x, int z, uvec2 range);
 int GetHeight(std::span<const float> noise, int i, uvec2 range);
@@ -126,6 +141,13 @@ void FillChunk(PaddedChunkGrid3D& grid, [[maybe_unused]] ivec3 chunk_start,
   }
 }
 
+// Single material height map fill that builds each mask column word directly and writes material
+// runs in bulk, instead of a Set per voxel. Voxel (x, y, z) is set when
+// (y * y_scale) + y_start < heights[(z * PCS) + x]. Only voxels within [first, last] on every axis
+// are written, so chunks whose padding comes from their neighbors can skip the padding ring.
+void FillChunkColumns(PaddedChunkGrid3D& grid, std::span<const int> heights, int y_start,
+                      int y_scale, uint8_t material, int first = 0, int last = PCS - 1);
+
 template <typename Func>
 void FillChunk(PaddedChunkGrid3D& grid, [[maybe_unused]] ivec3 chunk_start,
                std::span<const int> heights, Func&& func) {
@@ -148,11 +170,9 @@ template <typename Func>
 void FillChunk(PaddedChunkGrid3D& grid, [[maybe_unused]] ivec3 chunk_start,
                std::span<const float> heights, uvec2 height_map_range, Func&& func) {
   ZoneScoped;
-  std::vector<int> heights_computed(heights.size());
-  for (size_t i = 0; i < heights.size(); i++) {
-    heights_computed[i] = GetHeight(heights, i, height_map_range);
-  }
-  FillChunk(grid, chunk_start, heights_computed, func);
+  ChunkPaddedHeightMapGrid heights_computed;
+  NoiseToHeights(heights, heights_computed, height_map_range);
+  FillChunk(grid, chunk_start, std::span<const int>{heights_computed}, func);
 }
 
 struct FBMNoise {
@@ -161,6 +181,7 @@ struct FBMNoise {
   void Init(int seed, float frequency, int octaves);
   void GetNoise(std::span<float> out, uvec2 start, uvec2 size) const;
   void GetWhiteNoise(std::span<float> out, uvec2 start, uvec2 size) const;
+  [[nodiscard]] float Frequency() const { return frequency_; }
 
   template <int Len>
   void FillWhiteNoise(HeightMapFloats& out, uvec2 start) {
@@ -180,15 +201,67 @@ struct FBMNoise {
     fbm->GenUniformGrid2D(out.data(), start.x, start.y, Len, Len, frequency_, seed_);
   }
 
+  // Octaves whose frequency is above the Nyquist limit of the sample grid only alias, so they are
+  // dropped. sample_frequency is the frequency of the first octave per sample, i.e. the noise
+  // frequency times the sample spacing. Keeps at least one octave.
+  [[nodiscard]] int NyquistOctaves(float sample_frequency) const;
+  // FillNoise2D with only the octaves below the Nyquist limit, scaled to the amplitude they have in
+  // the full sum so dropping octaves doesn't stretch the output. start is in samples.
+  void FillNoise2DBandLimited(std::span<float> out, ivec2 start, uvec2 dims,
+                              float sample_frequency) const;
+
   FastNoise::SmartNode<FastNoise::FractalFBm> fbm;
   FastNoise::SmartNode<FastNoise::White> white_noise;
 
  private:
   void InitNoise();
+  // fbm_by_octaves_[i] sums the first i + 1 octaves of fbm
+  std::vector<FastNoise::SmartNode<FastNoise::FractalFBm>> fbm_by_octaves_;
   float white_freq_;
   float frequency_;
   int octaves_;
   int seed_;
 };
 
+// 3D density terrain with overhangs and caves, on top of the 2D height map. A voxel is solid when
+//   (height - y) / surface_falloff + surface_noise > 0  and  cave_noise < cave_threshold.
+// The noises stay within [-1, 1], so the surface noise only matters within surface_falloff voxels
+// of the height map range. The cave noise is sampled every CaveStep world voxels and interpolated
+// trilinearly between samples, so no voxel's cave value exceeds the largest sample around its
+// chunk. Chunks above the band are air, and chunks whose samples all stay below cave_threshold
+// have no caves, so chunks below the band are then solid without generating any noise at full
+// resolution.
+struct DensityNoise {
+  static constexpr float DefaultSurfaceFrequency{0.02};
+  static constexpr float DefaultCaveFrequency{0.03};
+  void Init(int seed);
+  // Same addressing as FillChunkColumns: padded layer y is at world height chunk_start.y + y and
+  // only voxels within [first, last] on every axis are written.
+  void FillChunk(PaddedChunkGrid3D& grid, ivec3 chunk_start, const HeightMapData& height_map,
+                 uint8_t material, int first = 0, int last = PCS - 1) const;
+
+  float surface_frequency{DefaultSurfaceFrequency};
+  float surface_falloff{12};
+  float cave_frequency{DefaultCaveFrequency};
+  float cave_threshold{0.4};
+  static constexpr int CaveStep = 4;
+
+ private:
+  // Samples of the cave noise at world voxels that are multiples of CaveStep, from the last one at
+  // or before a chunk's first voxel to the first one after its last, on each axis. Layout is the
+  // voxel grid's: z fastest, then x, then y.
+  struct CaveSamples {
+    static constexpr int MaxDims = ((PCS + CaveStep - 2) / CaveStep) + 2;
+    ivec3 min;
+    ivec3 dims;
+    std::array<float, MaxDims * MaxDims * MaxDims> values;
+  };
+  // Whether any sample reaches cave_threshold, i.e. whether the chunk may have caves
+  [[nodiscard]] bool SampleCaves(ivec3 chunk_start, int first, int last,
+                                 CaveSamples& samples) const;
+  FastNoise::SmartNode<FastNoise::FractalFBm> surface_;
+  FastNoise::SmartNode<FastNoise::FractalFBm> cave_;
+  int seed_{};
+};
+
 }  // namespace gen
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <span>
+#include <tuple>
+
+#include "voxels/Chunk.hpp"
+#include "voxels/Common.hpp"
+
+namespace gen {
+
+// Terrain generation composed at compile time from a height source, a layer rule and any number of
+// feature passes, so material assignment is inlined into the fill loops instead of going through a
+// per-voxel callback. The fill runs a y layer at a time over contiguous z rows of the ZXY grid,
+// which lets the compiler vectorize the layer rule and passes.
+//
+// Height source: void ColumnHeights(ivec3 chunk_start, std::span<int, PCS2> out) const
+//   writes the surface height of each padded column, out[(x * PCS) + z] (z fastest, like the grid).
+//   Voxels below the surface height are solid.
+// Layer rule: static constexpr int UniformDepth, uint8_t Material(int depth) const
+//   material of a solid voxel depth voxels below the surface, 0 being the top voxel. Must not
+//   return 0 and must return the same material for every depth >= UniformDepth.
+// Feature pass: void Apply(PaddedChunkGrid3D& grid, ivec3 chunk_start, int first, int last) const
+//   rewrites materials of the filled grid. Passes run in order and must not change which voxels
+//   are solid, the mask is built before they run.
+
+// Heights straight from a chunk height map, heights[(z * PCS) + x].
+struct HeightMapSource {
+  const HeightMapData* height_map;
+  void ColumnHeights(ivec3, std::span<int, PCS2> out) const {
+    for (int x = 0; x < PCS; x++) {
+      for (int z = 0; z < PCS; z++) {
+        out[(x * PCS) + z] = height_map->heights[(z * PCS) + x];
+      }
+    }
+  }
+};
+
+template <int Thickness, uint8_t Mat>
+struct Layer {
+  static_assert(Thickness > 0 && Mat != 0);
+  static constexpr int thickness = Thickness;
+  static constexpr uint8_t material = Mat;
+};
+
+// Layers from the surface down, then Base below them, e.g.
+// DepthLayers<Stone, Layer<1, Grass>, Layer<3, Dirt>>.
+template <uint8_t Base, typename... Layers>
+struct DepthLayers {
+  static_assert(Base != 0);
+  static constexpr int UniformDepth = (0 + ... + Layers::thickness);
+  uint8_t Material(int depth) const {
+    constexpr std::array<int, sizeof...(Layers)> Ends = [] {
+      std::array<int, sizeof...(Layers)> ends{Layers::thickness...};
+      for (size_t i = 1; i < ends.size(); i++) ends[i] += ends[i - 1];
+      return ends;
+    }();
+    constexpr std::array<uint8_t, sizeof...(Layers)> Materials{Layers::material...};
+    // selects from the deepest layer up, no branches
+    uint8_t mat = Base;
+    for (int i = static_cast<int>(Ends.size()) - 1; i >= 0; i--) {
+      mat = depth < Ends[i] ? Materials[i] : mat;
+    }
+    return mat;
+  }
+};
+
+constexpr uint32_t HashVoxel(int x, int y, int z, uint32_t seed) {
+  uint32_t h = seed ^ (static_cast<uint32_t>(x) * 0x8da6b343u) ^
+               (static_cast<uint32_t>(y) * 0xd8163841u) ^ (static_cast<uint32_t>(z) * 0xcb1ab31fu);
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  return h;
+}
+
+// Replaces Host voxels with Ore where a position hash falls below Chance / 65536.
+template <uint8_t Host, uint8_t Ore, uint32_t Chance>
+struct OrePass {
+  static_assert(Ore != 0 && Chance <= 65536);
+  uint32_t seed{};
+  void Apply(PaddedChunkGrid3D& grid, ivec3 chunk_start, int first, int last) const {
+    const auto& mask = grid.mask.mask;
+    for (int y = first; y <= last; y++) {
+      for (int x = first; x <= last; x++) {
+        if (!mask[(PCS * y) + x]) continue;
+        uint8_t* row = &grid.grid.grid[ZXY<PCS>(x, y, 0)];
+        const ivec3 world{chunk_start.x + x, chunk_start.y + y, chunk_start.z};
+        for (int z = first; z <= last; z++) {
+          const uint32_t h = HashVoxel(world.x, world.y, world.z + z, seed);
+          row[z] = (row[z] == Host && (h & 0xFFFF) < Chance) ? Ore : row[z];
+        }
+      }
+    }
+  }
+};
+
+template <typename HeightSource, typename LayerRule, typename... Passes>
+class TerrainPipeline {
+ public:
+  explicit TerrainPipeline(HeightSource source, LayerRule layers = {}, Passes... passes)
+      : source_(source), layers_(layers), passes_(passes...) {}
+
+  // Same addressing as FillChunkColumns: padded layer y is at world height chunk_start.y + y and
+  // only voxels within [first, last] on every axis are written. Expects a cleared grid.
+  void Fill(PaddedChunkGrid3D& grid, ivec3 chunk_start, int first = 0, int last = PCS - 1) const {
+    ZoneScoped;
+    std::array<int, PCS2> heights;
+    source_.ColumnHeights(chunk_start, heights);
+    int min_height = std::numeric_limits<int>::max();
+    int max_height = std::numeric_limits<int>::lowest();
+    for (int x = first; x <= last; x++) {
+      for (int z = first; z <= last; z++) {
+        min_height = std::min(min_height, heights[(x * PCS) + z]);
+        max_height = std::max(max_height, heights[(x * PCS) + z]);
+      }
+    }
+    const int top = std::min(last, max_height - 1 - chunk_start.y);
+    if (top < first) return;
+
+    const uint8_t base = layers_.Material(LayerRule::UniformDepth);
+    auto& mask = grid.mask.mask;
+    auto& voxels = grid.grid.grid;
+    for (int y = first; y <= top; y++) {
+      const int world_y = chunk_start.y + y;
+      // every column is deep enough for the base material
+      if (min_height - 1 - world_y >= LayerRule::UniformDepth) {
+        grid.FillBox({first, y, first}, {last + 1, y + 1, last + 1}, base);
+        continue;
+      }
+      for (int x = first; x <= last; x++) {
+        const int* column_heights = &heights[x * PCS];
+        uint8_t* row = &voxels[ZXY<PCS>(x, y, 0)];
+        uint64_t word = 0;
+        for (int z = first; z <= last; z++) {
+          const int depth = column_heights[z] - 1 - world_y;
+          row[z] = depth >= 0 ? layers_.Material(depth) : 0;
+          word |= static_cast<uint64_t>(depth >= 0) << z;
+        }
+        mask[(PCS * y) + x] |= word;
+      }
+    }
+    std::apply([&](const auto&... pass) { (pass.Apply(grid, chunk_start, first, last), ...); },
+               passes_);
+  }
+
+ private:
+  HeightSource source_;
+  LayerRule layers_;
+  std::tuple<Passes...> passes_;
+};
+
+}  // namespace gen
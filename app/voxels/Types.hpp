@@ -6,4 +6,7 @@ struct ChunkMeshUpload {
   uint32_t vert_counts[6];
   uint32_t staging_copy_idx;
   bool stale{false};
+  // Mesh handle this upload takes the place of, freed in the same call so the chunk is drawn with
+  // the old mesh until the new one is in, never both or neither. 0 for none.
+  uint32_t replaces{};
 };
@@ -11,36 +11,90 @@
 #include "pch.hpp"
 #include "voxels/Chunk.hpp"
 #include "voxels/Common.hpp"
-#include "voxels/Terrain.hpp"
 #include "voxels/Types.hpp"
 
 namespace {
 AutoCVarInt terrain_gen_chunks_y("world.terrain_gen_chunks_y", "Num chunks Y", 1);
 AutoCVarFloat freq("world.terrain_freq", "Freq", 0.002);
+AutoCVarInt material_plane_mesher("world.material_plane_mesher",
+                                  "Greedy merge per material bitmask", 0, CVarFlags::EditCheckbox);
+AutoCVarInt neighbor_padding("world.neighbor_padding",
+                             "Copy chunk padding from resident neighbors, applies on reset", 0,
+                             CVarFlags::EditCheckbox);
+AutoCVarInt density_terrain("world.density_terrain",
+                            "3D density terrain with overhangs and caves, applies on reset", 0,
+                            CVarFlags::EditCheckbox);
+AutoCVarInt layered_terrain("world.layered_terrain",
+                            "Grass, dirt and stone layers with ore, applies on reset", 0,
+                            CVarFlags::EditCheckbox);
+AutoCVarInt chunk_disk_cache("world.chunk_disk_cache",
+                             "Load generated chunks from disk, applies on reset", 0,
+                             CVarFlags::EditCheckbox);
+AutoCVarString chunk_cache_dir("world.chunk_cache_dir", "Chunk disk cache directory",
+                               GET_PATH("chunk_cache"));
+AutoCVarString region_dir("world.region_dir",
+                          "Directory of a world written by voxel_pregen, empty to generate", "");
+AutoCVarInt height_map_cache_mb("world.height_map_cache_mb",
+                                 "Height map cache memory budget in MiB, applies on reset", 64);
+AutoCVarInt resident_voxels("world.resident_voxels",
+                            "Keep the voxels of meshed chunks palette compressed, applies on reset",
+                            1, CVarFlags::EditCheckbox);
+AutoCVarInt mesh_batch_size("world.mesh_batch_size", "Chunks per mesh task", MaxMeshBatchSize);
+
+// Mesher scratch owned by each worker thread, reused by every chunk it meshes.
+thread_local std::unique_ptr<MeshAlgData> mesh_alg_scratch;
+
+ivec3 FloorDiv(ivec3 v, int d) {
+  auto div = [d](int x) { return (x >= 0 ? x : x - d + 1) / d; };
+  return {div(v.x), div(v.y), div(v.z)};
+}
 }  // namespace
 void VoxelWorld::Init() {
   max_terrain_tasks_ = 16;
   max_mesh_tasks_ = 16;
+  max_edit_mesh_tasks_ = 4;
 
   // TODO: refactor the counts here
-  mesh_alg_pool_.Init(max_mesh_tasks_);
-  mesher_output_data_pool_.Init(max_mesh_tasks_);
-  chunk_pool_.Init(max_terrain_tasks_ + max_mesh_tasks_);
-  height_map_pool_.Init(10000);
-
-  noise_.Init(seed_, freq.GetFloat(), 4);
+  chunk_pool_.Init(max_terrain_tasks_ +
+                   ((max_mesh_tasks_ + max_edit_mesh_tasks_) * MaxMeshBatchSize));
+  solid_grid_ = std::make_unique<PaddedChunkGrid3D>();
+  solid_grid_->FillBox(ivec3{0}, ivec3{PCS}, 128);
   initalized_ = true;
 }
 
 void VoxelWorld::GenerateWorld(vec3 cam_pos) {
   ZoneScoped;
   fmt::println("generating world: radius {}", radius_);
+  neighbor_padding_ = neighbor_padding.Get();
+  // With neighbor padding the full grids stay resident instead
+  resident_voxels_ = resident_voxels.Get() && !neighbor_padding_;
+  generator_.Init({.seed = seed_,
+                   .frequency = freq.GetFloat(),
+                   .chunks_y = terrain_gen_chunks_y.Get(),
+                   .density_terrain = density_terrain.Get() != 0,
+                   .layered_terrain = layered_terrain.Get() != 0},
+                  static_cast<size_t>(height_map_cache_mb.Get()) << 20);
+  if (chunk_disk_cache.Get()) {
+    const uint64_t settings =
+        ChunkDiskCache::HashSettings(generator_.SettingsHash(), neighbor_padding_);
+    chunk_cache_.Open(chunk_cache_dir.Get(), WorldGenerator::Version, settings, seed_);
+  } else {
+    chunk_cache_.Close();
+  }
+  if (!std::string_view{region_dir.Get()}.empty()) {
+    region_store_.Open(region_dir.Get(), WorldGenerator::Version, generator_.SettingsHash(),
+                       seed_);
+  } else {
+    region_store_.Close();
+  }
   curr_cam_pos_ = cam_pos;
   prev_cam_pos_ = cam_pos;
   ivec3 iter;
   int y = terrain_gen_chunks_y.Get();
   ivec3 cp = CamPosToChunkPos(cam_pos);
-  for (iter.y = 0; iter.y < y; iter.y++) {
+  // Tasks are taken from the back, so the bottom layer holding the surface goes first and the
+  // layers above find their column's height range cached, see ResolveWithoutTerrain
+  for (iter.y = y - 1; iter.y >= 0; iter.y--) {
     for (iter.x = cp.x - radius_; iter.x <= cp.x + radius_; iter.x++) {
       for (iter.z = cp.z - radius_; iter.z <= cp.z + radius_; iter.z++) {
         // if (iter.y == 0) fmt::println("{} {}", iter.x, iter.z);
@@ -62,8 +116,6 @@ void VoxelWorld::Update(vec3 cam_pos) {
   curr_cam_pos_ = cam_pos;
   stats_.max_terrain_done_size =
       std::max(stats_.max_terrain_done_size, terrain_tasks_.done_tasks.size_approx());
-  stats_.max_pool_size = std::max(stats_.max_pool_size, mesher_output_data_pool_.Size());
-  stats_.max_pool_size2 = std::max(stats_.max_pool_size2, mesh_alg_pool_.allocs);
   if (tot_chunks_loaded_ != prev_world_start_finished_chunks_ &&
       tot_chunks_loaded_ == world_gen_chunk_payload_) {
     world_load_time_ = world_start_timer_.ElapsedMS();
@@ -96,7 +148,7 @@ void VoxelWorld::Update(vec3 cam_pos) {
 
       ivec3 iter;
       ivec3 cp = curr_cp;
-      for (iter.y = 0; iter.y < y; iter.y++) {
+      for (iter.y = y - 1; iter.y >= 0; iter.y--) {
         for (iter.x = cp.x - radius_; iter.x <= cp.x + radius_; iter.x++) {
           for (iter.z = cp.z - radius_; iter.z <= cp.z + radius_; iter.z++) {
             make(iter);
@@ -118,7 +170,15 @@ void VoxelWorld::Update(vec3 cam_pos) {
                 if (it->second.mesh_handle) {
                   meshes_to_delete.emplace_back(it->second.mesh_handle);
                 }
+                // In flight grids are freed once they come back without a state, queue entries
+                // left behind are skipped
+                if (it->second.chunk_handle != NullChunkHandle && !it->second.mesh_in_flight) {
+                  chunk_pool_.Free(it->second.chunk_handle);
+                }
+                SetResidentVoxels(it->second, nullptr);
                 chunks.erase(it);
+                // Neighbors may be waiting on this chunk's terrain before meshing
+                if (neighbor_padding_) QueueUnmeshedNeighbors(pos);
               }
             }
           }
@@ -184,37 +244,89 @@ void VoxelWorld::Update(vec3 cam_pos) {
       // here, i allow more terrain tasks to be enqueued, bnut there aren't enough grids?
       // fmt::println("grids before dec: {}", grid_pool_.allocs);
       terrain_tasks_.in_flight--;
-      auto* chunk = chunk_pool_.Get(terrain_response.grid);
-      if (chunk->grid.mask.AnySolid()) {
-        MeshTaskEnqueue task;
-        task.chunk_handle = terrain_response.grid;
-        mesh_tasks_.to_complete.emplace(task);
-      } else {
-        tot_chunks_loaded_++;
+      if (neighbor_padding_) {
+        AddResidentChunk(terrain_response);
+        continue;
+      }
+      if (terrain_response.uniform) {
+        // Padding included, so there are no faces whatever the material
         chunk_pool_.Free(terrain_response.grid);
+        auto it = chunks.find(terrain_response.pos);
+        if (it != chunks.end()) {
+          ResolveUniform(it->second, *terrain_response.uniform);
+          it->second.state = ChunkState::Meshed;
+        }
+        tot_chunks_loaded_++;
+        continue;
       }
+      mesh_tasks_.to_complete.emplace(MeshTaskEnqueue{terrain_response.grid, terrain_response.pos});
     }
   }
+  ApplyEdits();
   {
     ZoneScopedN("dispatch mesh tasks");
-    while (mesh_tasks_.in_flight < max_mesh_tasks_ && mesh_tasks_.to_complete.size()) {
-      MeshTaskResponse response;
-
-      response.chunk_handle = mesh_tasks_.to_complete.front().chunk_handle;
-      auto& chunk = *chunk_pool_.Get(response.chunk_handle);
-      if (chunk.grid.mask.AllSet()) {
-        mesh_tasks_.to_complete.pop();
-        tot_chunks_loaded_++;
-        continue;
+    const uint32_t batch_size = std::clamp(mesh_batch_size.Get(), 1, MaxMeshBatchSize);
+    while (true) {
+      // Edits go first. They have an in flight limit of their own, so streaming work doesn't hold
+      // them back and a burst of edits can't take every worker.
+      const bool edits =
+          !edit_mesh_queue_.empty() && edit_mesh_tasks_in_flight_ < max_edit_mesh_tasks_;
+      if (!edits && (mesh_tasks_.to_complete.empty() ||
+                     mesh_tasks_.in_flight - edit_mesh_tasks_in_flight_ >= max_mesh_tasks_)) {
+        break;
+      }
+      auto& queue = edits ? edit_mesh_queue_ : mesh_tasks_.to_complete;
+      MeshBatchResponse batch;
+      batch.edit = edits;
+      while (batch.cnt < batch_size && !queue.empty()) {
+        const MeshTaskEnqueue queued = queue.front();
+        queue.pop();
+        auto& task = batch.tasks[batch.cnt];
+        task.chunk_handle = queued.chunk_handle;
+        task.chunk = nullptr;
+        task.pos = queued.pos;
+        task.solid_mask = nullptr;
+        task.edited = queued.edited;
+        if (neighbor_padding_) {
+          // Unloaded, or queued twice, once ahead for an edit, and already taken
+          auto* state = TaskChunk(queued.pos, queued.chunk_handle, true);
+          if (!state || !state->mesh_queued) continue;
+          task.edited = state->edited;
+          if (!PrepareResidentMesh(*state, queued.pos, task)) continue;
+          if (task.edited && !task.solid_mask) PrepareIncrementalMesh(*state, task);
+        } else if (chunk_pool_.Get(queued.chunk_handle)->grid.mask.AllSet()) {
+          // No faces, padding included
+          task.vertex_cnt = 0;
+          auto* state = TaskChunk(queued.pos, queued.chunk_handle, queued.edited);
+          std::shared_ptr<PaletteChunk> voxels;
+          if (resident_voxels_ && state) {
+            voxels = std::make_shared<PaletteChunk>();
+            voxels->Encode(chunk_pool_.Get(queued.chunk_handle)->grid);
+          }
+          if (state) {
+            // Not meshed, so the incremental mesh no longer matches the voxels
+            state->incremental = nullptr;
+            state->modified.clear();
+          }
+          FinishUnpaddedMesh(state, task, std::move(voxels));
+          continue;
+        } else if (queued.edited) {
+          auto* state = TaskChunk(queued.pos, queued.chunk_handle, true);
+          if (state) PrepareIncrementalMesh(*state, task);
+        }
+        if (!task.solid_mask) task.chunk = chunk_pool_.Get(task.chunk_handle);
+        batch.cnt++;
       }
-      response.alg_data_handle = mesh_alg_pool_.Alloc();
-      response.output_data_handle = mesher_output_data_pool_.Alloc();
+      if (batch.cnt == 0) continue;
 
-      mesh_tasks_.to_complete.pop();
-      thread_pool.detach_task([this, response]() mutable {
-        mesh_tasks_.done_tasks.enqueue(ProcessMeshTask(response));
+      thread_pool.detach_task([this, batch]() mutable {
+        ProcessMeshBatch(batch);
+        mesh_tasks_.done_tasks.enqueue(batch);
       });
       mesh_tasks_.in_flight++;
+      if (edits) edit_mesh_tasks_in_flight_++;
+      stats_.tot_mesh_batches++;
+      stats_.tot_mesh_batch_chunks += batch.cnt;
     }
   }
 
@@ -223,87 +335,126 @@ void VoxelWorld::Update(vec3 cam_pos) {
     while (terrain_tasks_.in_flight < max_terrain_tasks_ && !to_gen_terrain_tasks_.empty()) {
       auto pos = to_gen_terrain_tasks_.back();
       to_gen_terrain_tasks_.pop_back();
+      if (ResolveWithoutTerrain(pos)) continue;
       auto chunk_handle = chunk_pool_.Alloc();
       auto* chunk = chunk_pool_.Get(chunk_handle);
       EASSERT(chunk);
       chunk->pos = pos;
-      TerrainGenTask terrain_task{chunk_handle};
+      TerrainGenTask terrain_task{chunk_handle, chunk};
       terrain_tasks_.in_flight++;
       {
         ZoneScopedN("detatch");
         thread_pool.detach_task([terrain_task, this]() {
-          terrain_tasks_.done_tasks.enqueue(ProcessTerrainTask(terrain_task));
+          terrain_tasks_.done_tasks.enqueue(LoadOrGenerateTerrain(terrain_task));
         });
       }
     }
   }
 
-  MeshTaskResponse mesh_task;
+  MeshBatchResponse mesh_batch;
   {
     ZoneScopedN("chunk mesh upload process");
     chunk_mesh_uploads_.clear();
-    while (mesh_tasks_.in_flight > 0 && mesh_tasks_.done_tasks.try_dequeue(mesh_task)) {
-      auto& alg_data = *mesh_alg_pool_.Get(mesh_task.alg_data_handle);
-      auto& data = *mesher_output_data_pool_.Get(mesh_task.output_data_handle);
-      if (data.vertex_cnt > 0) {
-        stats_.tot_quads += data.vertex_cnt;
-        ChunkMeshUpload u{};
-        u.staging_copy_idx = mesh_task.staging_copy_idx;
-        int m = 1;
-        u.mult = 1 << (m - 1);
-        // fmt::println("{}", u.mult);
-        u.pos = chunk_pool_.Get(mesh_task.chunk_handle)->pos * CS * u.mult;
-        for (int i = 0; i < 6; i++) {
-          u.vert_counts[i] = alg_data.face_vertex_lengths[i];
+    while (mesh_tasks_.in_flight > 0 && mesh_tasks_.done_tasks.try_dequeue(mesh_batch)) {
+      for (uint32_t t = 0; t < mesh_batch.cnt; t++) {
+        auto& mesh_task = mesh_batch.tasks[t];
+        const ivec3 pos = mesh_task.pos;
+        // Unloaded while meshing, the staging copy is still handed over so it gets released
+        auto* state = TaskChunk(pos, mesh_task.chunk_handle,
+                                neighbor_padding_ || mesh_task.edited);
+        if (mesh_task.vertex_cnt > 0) {
+          stats_.tot_quads += mesh_task.vertex_cnt;
+          ChunkMeshUpload u{};
+          u.stale = !state;
+          u.staging_copy_idx = mesh_task.staging_copy_idx;
+          int m = 1;
+          u.mult = 1 << (m - 1);
+          u.pos = pos * CS * u.mult;
+          for (int i = 0; i < 6; i++) {
+            u.vert_counts[i] = mesh_task.face_vertex_lengths[i];
+          }
+          // Remeshed chunks swap meshes in the upload
+          if (state) u.replaces = state->mesh_handle;
+          chunk_mesh_uploads_.emplace_back(u);
+          stats_.tot_meshes++;
+        }
+        if (neighbor_padding_ && state) {
+          state->mesh_in_flight = false;
+          if (mesh_task.vertex_cnt == 0 && state->mesh_handle) {
+            meshes_to_delete.emplace_back(state->mesh_handle);
+            state->mesh_handle = 0;
+          }
+          if (state->state != ChunkState::Meshed) {
+            state->state = ChunkState::Meshed;
+            tot_chunks_loaded_++;
+          }
+          if (state->remesh) {
+            const bool edit = state->remesh_edit;
+            state->remesh = false;
+            state->remesh_edit = false;
+            QueueMesh(*state, pos, edit);
+          }
+        } else if (neighbor_padding_) {
+          if (mesh_task.chunk_handle != NullChunkHandle) chunk_pool_.Free(mesh_task.chunk_handle);
+        } else {
+          FinishUnpaddedMesh(state, mesh_task, std::move(mesh_task.voxels));
         }
-        chunk_mesh_uploads_.emplace_back(u);
-        stats_.tot_meshes++;
       }
       mesh_tasks_.in_flight--;
-      chunk_pool_.Free(mesh_task.chunk_handle);
-      mesh_alg_pool_.Free(mesh_task.alg_data_handle);
-      mesher_output_data_pool_.Free(mesh_task.output_data_handle);
-      tot_chunks_loaded_++;
+      if (mesh_batch.edit) edit_mesh_tasks_in_flight_--;
     }
   }
   ChunkMeshManager::Get().FreeMeshes(meshes_to_delete);
   meshes_to_delete.clear();
 
   if (chunk_mesh_uploads_.size()) {
-    // TODO: fix
+    // Handles are only appended for uploads that aren't stale
     mesh_handle_alloc_buffer_.clear();
-    mesh_handle_alloc_buffer_.resize(chunk_mesh_uploads_.size());
     ChunkMeshManager::Get().UploadChunkMeshes(chunk_mesh_uploads_, mesh_handle_alloc_buffer_);
-    for (size_t i = 0; i < chunk_mesh_uploads_.size(); i++) {
-      auto pos = chunk_mesh_uploads_[i].pos / CS;
-      auto it = chunks.find(pos);
-      if (it == chunks.end()) {
-        fmt::println(" {} {} {}", pos.x, pos.y, pos.z);
-      }
+    size_t j = 0;
+    for (const auto& upload : chunk_mesh_uploads_) {
+      if (upload.stale) continue;
+      auto it = chunks.find(upload.pos / CS);
       EASSERT(it != chunks.end());
-      it->second.mesh_handle = mesh_handle_alloc_buffer_[i];
+      // The previous mesh was freed by the upload, see ChunkMeshUpload::replaces
+      it->second.mesh_handle = mesh_handle_alloc_buffer_[j++];
       it->second.state = ChunkState::Meshed;
     }
   }
 }
 
+TerrainGenResponse VoxelWorld::LoadOrGenerateTerrain(const TerrainGenTask& task) {
+  auto* chunk = task.chunk;
+  // a load writes the whole grid, a miss is cleared by ProcessTerrainTask
+  bool loaded = region_store_.IsOpen() && region_store_.LoadChunk(chunk->pos, 0, chunk->grid);
+  if (!loaded && chunk_cache_.IsOpen()) loaded = chunk_cache_.Load(chunk->pos, 0, chunk->grid);
+  if (!loaded) {
+    ProcessTerrainTask(task);
+    chunk_cache_.Store(chunk->pos, 0, chunk->grid);
+  }
+  TerrainGenResponse res{task.chunk_handle, chunk->pos};
+  // Only the interior is generated with neighbor padding
+  res.uniform =
+      neighbor_padding_ ? chunk->grid.UniformMaterial(1, CS) : chunk->grid.UniformMaterial();
+  return res;
+}
+
 TerrainGenResponse VoxelWorld::ProcessTerrainTask(const TerrainGenTask& task) {
   ZoneScoped;
   // ChunkPaddedHeightMapGrid heights;
   // FloatArray3D<i8vec3{PCS}> white_noise_floats;
   // ChunkPaddedHeightMapFloats height_map_floats;
   // HeightMapFloats<i8vec3{PCS}> white_noise_floats;
-  auto* chunk = chunk_pool_.Get(task.chunk_handle);
+  auto* chunk = task.chunk;
   chunk->grid.Clear();
   // noise.FillNoise2D(height_map_floats, ivec2{chunk->pos.x, chunk->pos.z} * CS, uvec2{PCS}, m);
   // gen::NoiseToHeights(height_map_floats, heights,
   //                     {0, (((terrain_gen_chunks_y.Get() * CS / m) - 1))});
-  auto* height_map = GetHeightMap(chunk->pos.x, chunk->pos.z);
   // gen::FillSphere<PCS>(chunk->grid, 128);
-  gen::FillChunk(chunk->grid, chunk->pos * CS, *height_map, [](int, int, int) {
-    // return (rand() % 255) + 1;
-    return 128;
-  });
+  // Resident neighbors provide the padding, see PrepareResidentMesh
+  const int first = neighbor_padding_ ? 1 : 0;
+  const int last = neighbor_padding_ ? CS : PCS - 1;
+  generator_.FillChunk(chunk->grid, chunk->pos, 0, first, last);
   // for (int z = 2; z < 4; z++) {
   //   for (int y = 2; y < 4; y++) {
   //     for (int x = 2; x < 4; x++) {
@@ -329,31 +480,408 @@ TerrainGenResponse VoxelWorld::ProcessTerrainTask(const TerrainGenTask& task) {
   return {task.chunk_handle, chunk->pos};
 }
 
-MeshTaskResponse VoxelWorld::ProcessMeshTask(MeshTaskResponse& task) {
+void VoxelWorld::ProcessMeshBatch(MeshBatchResponse& batch) {
+  ZoneScoped;
+  if (!mesh_alg_scratch) {
+    mesh_alg_scratch = std::make_unique<MeshAlgData>();
+  }
+  MeshAlgData& alg_data = *mesh_alg_scratch;
+  for (uint32_t t = 0; t < batch.cnt; t++) {
+    auto& task = batch.tasks[t];
+    if (task.solid_mask) {
+      alg_data.mask = task.solid_mask.get();
+      StagingMeshSink sink;
+      GenerateSolidChunkMesh(task.solid_material, alg_data, sink);
+      task.solid_mask = nullptr;
+      task.vertex_cnt = sink.vertex_cnt;
+      task.staging_copy_idx = sink.staging_copy_idx;
+      task.face_vertex_lengths = alg_data.face_vertex_lengths;
+      continue;
+    }
+    auto& chunk = *task.chunk;
+    alg_data.mask = &chunk.grid.mask;
+    if (resident_voxels_) {
+      task.voxels = std::make_shared<PaletteChunk>();
+      task.voxels->Encode(chunk.grid);
+    }
+    StagingMeshSink sink;
+    if (task.incremental) {
+      // Meshed by slice whatever material_plane_mesher is, see ChunkState::incremental. Past a
+      // column per modified voxel reculling costs more than meshing whole.
+      if (task.incremental_meshed && task.modified.size() < CS2) {
+        RemeshVoxels(chunk.grid.grid.grid, alg_data, task.modified, *task.incremental);
+      } else {
+        GenerateMeshIncremental(chunk.grid.grid.grid, alg_data, *task.incremental);
+      }
+      task.modified = {};
+      CopyIncrementalMesh(*task.incremental, sink);
+      task.vertex_cnt = sink.vertex_cnt;
+      task.staging_copy_idx = sink.staging_copy_idx;
+      task.face_vertex_lengths = task.incremental->face_vertex_lengths;
+      continue;
+    }
+    if (!task.edited && region_store_.LoadMesh(chunk.pos, 0, sink, task.face_vertex_lengths)) {
+      task.vertex_cnt = sink.vertex_cnt;
+      task.staging_copy_idx = sink.staging_copy_idx;
+      continue;
+    }
+    if (material_plane_mesher.Get()) {
+      GenerateMeshMaterialPlanes(chunk.grid.grid.grid, alg_data, sink);
+    } else {
+      GenerateMesh(chunk.grid.grid.grid, alg_data, sink);
+    }
+    task.vertex_cnt = sink.vertex_cnt;
+    task.staging_copy_idx = sink.staging_copy_idx;
+    task.face_vertex_lengths = alg_data.face_vertex_lengths;
+  }
+}
+
+void VoxelWorld::SetResidentVoxels(ChunkState& state, std::shared_ptr<const PaletteChunk> voxels) {
+  if (state.voxels) stats_.resident_voxel_bytes -= state.voxels->MemoryUsage();
+  state.voxels = std::move(voxels);
+  if (state.voxels) stats_.resident_voxel_bytes += state.voxels->MemoryUsage();
+}
+
+// Settles chunks the height range alone proves all air or all solid, without a grid from the pool
+// or a terrain task. Neither has visible faces. Returns false if the chunk needs generating.
+bool VoxelWorld::ResolveWithoutTerrain(ivec3 pos) {
+  const auto fill = generator_.ClassifyChunk(pos);
+  if (fill == WorldGenerator::ChunkFill::Unknown) return false;
+  auto it = chunks.find(pos);
+  // Unloaded since it was queued
+  if (it == chunks.end() || it->second.state != ChunkState::None) return true;
+  auto& state = it->second;
+  state.state = ChunkState::Meshed;
+  // Padding copied from a buried chunk is solid, see PrepareResidentMesh
+  state.uniform_solid = fill == WorldGenerator::ChunkFill::Solid;
+  tot_chunks_loaded_++;
+  if (state.uniform_solid) {
+    stats_.solid_chunks_skipped++;
+  } else {
+    stats_.air_chunks_skipped++;
+  }
+  if (neighbor_padding_) QueueUnmeshedNeighbors(pos);
+  return true;
+}
+
+// Keeps a chunk generated as a single material as that material alone, its grid already freed.
+void VoxelWorld::ResolveUniform(ChunkState& state, uint8_t material) {
+  stats_.uniform_chunks++;
+  state.uniform_solid = material != 0;
+  state.uniform_material = material;
+  if (resident_voxels_ && material) {
+    SetResidentVoxels(state, std::make_shared<const PaletteChunk>(material));
+  }
+}
+
+// Takes a chunk whose terrain just finished. Solid chunks stay resident, uniform ones without
+// their grid, and are queued for meshing along with the resident neighbors whose padding they
+// change.
+void VoxelWorld::AddResidentChunk(const TerrainGenResponse& response) {
+  const ivec3 pos = response.pos;
+  auto it = chunks.find(pos);
+  if (it == chunks.end() || it->second.state != ChunkState::None) {
+    chunk_pool_.Free(response.grid);
+    return;
+  }
+  auto& state = it->second;
+  if (response.uniform) {
+    chunk_pool_.Free(response.grid);
+    ResolveUniform(state, *response.uniform);
+    if (!state.uniform_solid) {
+      state.state = ChunkState::Meshed;
+      tot_chunks_loaded_++;
+      // Padding toward an air chunk is already clear, only neighbors waiting on it need queueing
+      QueueUnmeshedNeighbors(pos);
+      return;
+    }
+  } else {
+    state.chunk_handle = response.grid;
+  }
+  state.state = ChunkState::TerrainGenerated;
+  for (const ivec3& dir : ChunkNeighborDirs) {
+    auto n = chunks.find(pos + dir);
+    if (n != chunks.end() &&
+        (n->second.chunk_handle != NullChunkHandle || n->second.uniform_material)) {
+      QueueMesh(n->second, pos + dir);
+    }
+  }
+  QueueMesh(state, pos);
+}
+
+void VoxelWorld::QueueMesh(ChunkState& state, ivec3 pos, bool edit) {
+  if (state.mesh_in_flight) {
+    state.remesh = true;
+    state.remesh_edit |= edit;
+    return;
+  }
+  // Already queued behind streaming work, an edit queues it again ahead and the entry taken
+  // second is skipped
+  if (state.mesh_queued && !edit) return;
+  state.mesh_queued = true;
+  auto& queue = edit ? edit_mesh_queue_ : mesh_tasks_.to_complete;
+  queue.emplace(MeshTaskEnqueue{state.chunk_handle, pos});
+}
+
+void VoxelWorld::QueueUnmeshedNeighbors(ivec3 pos) {
+  for (const ivec3& dir : ChunkNeighborDirs) {
+    auto n = chunks.find(pos + dir);
+    if (n != chunks.end() && n->second.state == ChunkState::TerrainGenerated) {
+      QueueMesh(n->second, pos + dir);
+    }
+  }
+}
+
+// Copies the padding from the neighbors and returns whether the chunk should be meshed now. Runs on
+// the main thread while no task reads the chunk. Chunks wait for neighbors whose terrain is still
+// pending, which queue them again once generated. Neighbors outside the loaded area count as air.
+// Uniform solid chunks get a mask of their own in task instead of a grid.
+bool VoxelWorld::PrepareResidentMesh(ChunkState& state, ivec3 pos, MeshTaskResponse& task) {
+  ZoneScoped;
+  state.mesh_queued = false;
+  std::array<const PaddedChunkGrid3D*, 6> neighbors{};
+  for (int dir = 0; dir < 6; dir++) {
+    auto it = chunks.find(pos + ChunkNeighborDirs[dir]);
+    if (it == chunks.end()) continue;
+    if (it->second.state == ChunkState::None) return false;
+    if (it->second.chunk_handle != NullChunkHandle) {
+      neighbors[dir] = &chunk_pool_.Get(it->second.chunk_handle)->grid;
+    } else if (it->second.uniform_solid) {
+      neighbors[dir] = solid_grid_.get();
+    }
+  }
+  PaddedChunkMask* mask;
+  if (state.chunk_handle == NullChunkHandle) {
+    task.solid_mask = std::make_shared<PaddedChunkMask>();
+    task.solid_material = state.uniform_material;
+    mask = task.solid_mask.get();
+    memset(mask->mask.data(), 0xff, sizeof(mask->mask));
+    for (int dir = 0; dir < 6; dir++) {
+      CopyNeighborPaddingMask(*mask, neighbors[dir], dir);
+    }
+  } else {
+    auto& grid = chunk_pool_.Get(state.chunk_handle)->grid;
+    mask = &grid.mask;
+    auto* modified = state.incremental ? &state.modified : nullptr;
+    for (int dir = 0; dir < 6; dir++) {
+      CopyNeighborPadding(grid, neighbors[dir], dir, modified);
+    }
+  }
+  if (mask->AllSet()) {
+    task.solid_mask = nullptr;
+    // Not meshed, so the incremental mesh no longer matches the voxels
+    state.incremental = nullptr;
+    state.modified.clear();
+    if (state.mesh_handle) {
+      meshes_to_delete.emplace_back(state.mesh_handle);
+      state.mesh_handle = 0;
+    }
+    if (state.state != ChunkState::Meshed) {
+      state.state = ChunkState::Meshed;
+      tot_chunks_loaded_++;
+    }
+    return false;
+  }
+  state.mesh_in_flight = true;
+  return true;
+}
+
+VoxelWorld::ChunkState* VoxelWorld::TaskChunk(ivec3 pos, uint32_t chunk_handle, bool owns_grid) {
+  auto it = chunks.find(pos);
+  if (it == chunks.end() || (owns_grid && it->second.chunk_handle != chunk_handle)) return nullptr;
+  return &it->second;
+}
+
+// Takes a chunk meshed without neighbor padding back from its task, state null if it was unloaded
+// since. The task's grid returns to the pool.
+void VoxelWorld::FinishUnpaddedMesh(ChunkState* state, const MeshTaskResponse& task,
+                                    std::shared_ptr<const PaletteChunk> voxels) {
+  if (state) {
+    if (voxels) SetResidentVoxels(*state, std::move(voxels));
+    if (task.vertex_cnt == 0 && state->mesh_handle) {
+      meshes_to_delete.emplace_back(state->mesh_handle);
+      state->mesh_handle = 0;
+    }
+    state->state = ChunkState::Meshed;
+    if (task.edited) {
+      state->chunk_handle = NullChunkHandle;
+      state->mesh_in_flight = false;
+    }
+  }
+  if (task.chunk_handle != NullChunkHandle) chunk_pool_.Free(task.chunk_handle);
+  if (!task.edited) tot_chunks_loaded_++;
+}
+
+bool VoxelWorld::SetVoxel(ivec3 pos, uint8_t material) {
+  return FillBox(pos, pos + 1, material) > 0;
+}
+
+size_t VoxelWorld::SetVoxels(std::span<const VoxelEdit> edits) {
+  size_t kept = 0;
+  for (const auto& edit : edits) kept += FillBox(edit.pos, edit.pos + 1, edit.material);
+  return kept;
+}
+
+size_t VoxelWorld::FillBox(ivec3 min, ivec3 max, uint8_t material) {
   ZoneScoped;
-  auto& chunk = *chunk_pool_.Get(task.chunk_handle);
-  MeshAlgData* alg_data = mesh_alg_pool_.Get(task.alg_data_handle);
-  EASSERT(alg_data);
-  alg_data->mask = &chunk.grid.mask;
-  auto* data = mesher_output_data_pool_.Get(task.output_data_handle);
-  GenerateMesh(chunk.grid.grid.grid, *alg_data, *data);
-
-  if (data->vertex_cnt) {
-    task.staging_copy_idx =
-        ChunkMeshManager::Get().CopyChunkToStaging(data->vertices.data(), data->vertex_cnt);
-  }
-  return task;
+  if (!neighbor_padding_ && !resident_voxels_) return 0;
+  if (min.x >= max.x || min.y >= max.y || min.z >= max.z) return 0;
+  // Padded coordinates an edit writes. With neighbor padding only the interior, which neighbors
+  // copy their padding from, otherwise every chunk keeps its own padding and takes the edit too.
+  const int lo = neighbor_padding_ ? 1 : 0;
+  const int hi = neighbor_padding_ ? CS + 1 : PCS;
+  const ivec3 first = FloorDiv(min - hi, CS) + 1;
+  const ivec3 last = FloorDiv(max - 1 - lo, CS);
+  size_t kept = 0;
+  ivec3 pos;
+  for (pos.y = first.y; pos.y <= last.y; pos.y++) {
+    for (pos.x = first.x; pos.x <= last.x; pos.x++) {
+      for (pos.z = first.z; pos.z <= last.z; pos.z++) {
+        auto it = chunks.find(pos);
+        if (it == chunks.end()) continue;
+        const ivec3 origin = pos * CS;
+        const ivec3 box_min = glm::clamp(min - origin, ivec3{lo}, ivec3{hi});
+        const ivec3 box_max = glm::clamp(max - origin, ivec3{lo}, ivec3{hi});
+        auto& state = it->second;
+        if (state.edits.empty()) edited_chunks_.emplace_back(pos);
+        state.edits.push_back({i8vec3{box_min}, i8vec3{box_max}, material});
+        // Counted by the chunk whose interior holds the voxel
+        const ivec3 size = glm::min(box_max, ivec3{CS + 1}) - glm::max(box_min, ivec3{1});
+        if (size.x > 0 && size.y > 0 && size.z > 0) {
+          kept += static_cast<size_t>(size.x) * size.y * size.z;
+        }
+      }
+    }
+  }
+  return kept;
+}
+
+// Applies the pending edits of every chunk that can take them and queues its remesh. Chunks still
+// loading wait, as do chunks being meshed since a worker reads their grid.
+void VoxelWorld::ApplyEdits() {
+  ZoneScoped;
+  // With neighbor padding the grid is resident as soon as it's generated
+  const auto loaded = neighbor_padding_ ? ChunkState::TerrainGenerated : ChunkState::Meshed;
+  size_t waiting = 0;
+  for (size_t i = 0; i < edited_chunks_.size(); i++) {
+    const ivec3 pos = edited_chunks_[i];
+    auto it = chunks.find(pos);
+    if (it == chunks.end() || it->second.edits.empty()) continue;
+    auto& state = it->second;
+    if (state.state < loaded || state.mesh_in_flight) {
+      edited_chunks_[waiting++] = pos;
+      continue;
+    }
+    auto& grid = chunk_pool_.Get(EditGrid(state, pos))->grid;
+    for (const auto& edit : state.edits) {
+      grid.FillBox(ivec3{edit.min}, ivec3{edit.max}, edit.material);
+      if (state.incremental) AppendRemeshBox(ivec3{edit.min}, ivec3{edit.max}, state.modified);
+    }
+    state.edited = true;
+    stats_.edit_remeshes++;
+    if (neighbor_padding_) {
+      QueueEditedNeighbors(pos, state);
+      QueueMesh(state, pos, true);
+    } else {
+      // The grid goes to the mesh task, which encodes it as the chunk's new resident voxels
+      state.mesh_in_flight = true;
+      edit_mesh_queue_.emplace(MeshTaskEnqueue{state.chunk_handle, pos, true});
+    }
+    state.edits = {};
+  }
+  edited_chunks_.resize(waiting);
+}
+
+// Edited chunks are remeshed from the slices kept of their last mesh, the first edit meshes the
+// chunk whole into a new one. Runs on the main thread while no task holds the chunk.
+void VoxelWorld::PrepareIncrementalMesh(ChunkState& state, MeshTaskResponse& task) {
+  task.incremental_meshed = state.incremental != nullptr;
+  if (!state.incremental) state.incremental = std::make_shared<IncrementalMeshData>();
+  task.incremental = state.incremental;
+  task.modified = std::move(state.modified);
+  state.modified.clear();
+}
+
+// The chunk's grid to apply edits to. Chunks kept without one get a grid from the pool holding
+// their voxels: decoded from the resident ones, filled with their single material, generated for
+// buried chunks that never were, or cleared for air.
+uint32_t VoxelWorld::EditGrid(ChunkState& state, ivec3 pos) {
+  if (state.chunk_handle != NullChunkHandle) return state.chunk_handle;
+  const uint32_t handle = chunk_pool_.Alloc();
+  auto* chunk = chunk_pool_.Get(handle);
+  chunk->pos = pos;
+  auto& grid = chunk->grid;
+  if (state.voxels) {
+    state.voxels->Decode(grid);
+  } else if (state.uniform_material) {
+    grid.FillBox(ivec3{0}, ivec3{PCS}, state.uniform_material);
+  } else if (state.uniform_solid) {
+    grid.Clear();
+    const int first = neighbor_padding_ ? 1 : 0;
+    const int last = neighbor_padding_ ? CS : PCS - 1;
+    generator_.FillChunk(grid, pos, 0, first, last);
+  } else {
+    grid.Clear();
+  }
+  state.chunk_handle = handle;
+  state.uniform_solid = false;
+  state.uniform_material = 0;
+  return handle;
+}
+
+// With neighbor padding, queues the neighbors whose padding copies a border layer the chunk's
+// pending edits write. Air neighbors have no faces either way, buried ones get a grid since the
+// edit may uncover some.
+void VoxelWorld::QueueEditedNeighbors(ivec3 pos, const ChunkState& state) {
+  int dirs = 0;
+  for (const auto& edit : state.edits) {
+    // ChunkNeighborDirs holds the -axis then the +axis neighbor of each axis
+    for (int axis = 0; axis < 3; axis++) {
+      if (edit.min[axis] == 1) dirs |= 1 << (axis * 2);
+      if (edit.max[axis] == CS + 1) dirs |= 1 << ((axis * 2) + 1);
+    }
+  }
+  for (int dir = 0; dir < 6; dir++) {
+    if (!(dirs & (1 << dir))) continue;
+    const ivec3 neighbor_pos = pos + ChunkNeighborDirs[dir];
+    auto it = chunks.find(neighbor_pos);
+    // Neighbors still generating copy the padding when they're first meshed
+    if (it == chunks.end() || it->second.state == ChunkState::None) continue;
+    auto& neighbor = it->second;
+    if (neighbor.chunk_handle == NullChunkHandle && !neighbor.uniform_solid) continue;
+    if (neighbor.chunk_handle == NullChunkHandle && !neighbor.uniform_material) {
+      EditGrid(neighbor, neighbor_pos);
+    }
+    neighbor.edited = true;
+    QueueMesh(neighbor, neighbor_pos, true);
+  }
 }
 
 void VoxelWorld::DrawImGuiStats() {
   if (ImGui::TreeNodeEx("maxes", ImGuiTreeNodeFlags_DefaultOpen)) {
     ImGui::Text("terrain done queue: %ld", stats_.max_terrain_done_size);
-    ImGui::Text("mesher_output_data_pool_ : %ld", stats_.max_pool_size);
-    ImGui::Text("mesher_output_data_pool_ max : %ld", stats_.max_pool_size);
-    ImGui::Text("mesh_alg_pool_: %ld", stats_.max_pool_size2);
+    ImGui::Text("avg chunks per mesh task: %ld",
+                stats_.tot_mesh_batch_chunks / std::max(stats_.tot_mesh_batches, 1ul));
     ImGui::Text("noise_generator_pool_: %ld", stats_.max_pool_size3);
     ImGui::Text("terrain tasks in flight: %ld", terrain_tasks_.in_flight);
-    ImGui::Text("mesh tasks in flight: %ld", mesh_tasks_.in_flight);
+    ImGui::Text("mesh tasks in flight: %ld, edits %zu", mesh_tasks_.in_flight,
+                edit_mesh_tasks_in_flight_);
+    ImGui::Text("chunks skipped: %zu air, %zu solid", stats_.air_chunks_skipped,
+                stats_.solid_chunks_skipped);
+    ImGui::Text("uniform chunks generated: %zu", stats_.uniform_chunks);
+    ImGui::Text("resident voxels: %zu kb", stats_.resident_voxel_bytes >> 10);
+    ImGui::Text("edit remeshes: %zu", stats_.edit_remeshes);
+    const auto& height_maps = generator_.HeightMaps();
+    auto hm_stats = height_maps.GetStats();
+    if (chunk_cache_.IsOpen()) {
+      auto cache_stats = chunk_cache_.GetStats();
+      ImGui::Text("chunk disk cache: hits %lu, misses %lu, stores %lu, %lu mb written",
+                  cache_stats.hits, cache_stats.misses, cache_stats.stores,
+                  cache_stats.bytes_written >> 20);
+    }
+    ImGui::Text("height maps: %zu/%zu, hits %lu, misses %lu, waits %lu, evictions %lu",
+                height_maps.Size(), height_maps.Capacity(), hm_stats.hits, hm_stats.misses,
+                hm_stats.waits, hm_stats.evictions);
     ImGui::TreePop();
   }
   ImGui::Text("Quad count: %ld, quad mem size: %ld mb", ChunkMeshManager::Get().QuadCount(),
@@ -364,6 +892,10 @@ void VoxelWorld::DrawImGuiStats() {
   ImGui::Text("meshes: %ld, quads: %ld, avg mesh quads: %ld", stats_.tot_meshes, stats_.tot_quads,
               stats_.tot_quads / std::max(stats_.tot_meshes, 1ul));
   ImGui::DragInt("radius", &radius_);
+  if (ImGui::Button("clear box at camera")) {
+    const ivec3 center{curr_cam_pos_};
+    FillBox(center - 8, center + 8, 0);
+  }
 }
 
 void VoxelWorld::Shutdown() {
@@ -380,6 +912,7 @@ void VoxelWorld::ResetInternal() {
   stats_ = {};
   chunk_mesh_uploads_.clear();
   ResetPools();
+  chunks.clear();
 }
 void VoxelWorld::Reset() {
   ResetInternal();
@@ -388,43 +921,14 @@ void VoxelWorld::Reset() {
 
 void VoxelWorld::ResetPools() {
   chunk_pool_.ClearNoDealloc();
-  mesh_alg_pool_.ClearNoDealloc();
-  mesher_output_data_pool_.ClearNoDealloc();
-  height_map_pool_.ClearNoDealloc();
-  height_map_pool_idx_cache_.clear();
   while (terrain_tasks_.in_flight > 0 || mesh_tasks_.in_flight > 0) {
     Update(curr_cam_pos_);
   }
   terrain_tasks_.Clear();
   mesh_tasks_.Clear();
-}
-
-HeightMapData* VoxelWorld::GetHeightMap(int x, int y) {
-  ZoneScoped;
-  {
-    std::lock_guard<std::mutex> lock(height_map_mtx_);
-    auto it = height_map_pool_idx_cache_.find({x, y});
-    if (it != height_map_pool_idx_cache_.end()) {
-      return height_map_pool_.Get(it->second);
-    }
-  }
-  uint32_t idx;
-  {
-    std::lock_guard<std::mutex> lock(height_map_mtx_);
-    idx = height_map_pool_.Alloc();
-  }
-  ChunkPaddedHeightMapFloats height_map_floats;
-  auto* height_map = height_map_pool_.Get(idx);
-  // TODO: pass scale in
-  noise_.FillNoise2D(height_map_floats, ivec2{x, y} * CS, uvec2{PCS}, 2);
-  gen::NoiseToHeights(height_map_floats, *height_map,
-                      {0, (terrain_gen_chunks_y.Get() * CS * 0.5) - 1});
-
-  {
-    std::lock_guard<std::mutex> lock(height_map_mtx_);
-    height_map_pool_idx_cache_.emplace(std::make_pair(x, y), idx);
-  }
-  return height_map;
+  mesh_tasks_.to_complete = {};
+  edit_mesh_queue_ = {};
+  edited_chunks_.clear();
 }
 
 ivec3 VoxelWorld::CamPosToChunkPos(vec3 cam_pos) { return ivec3(cam_pos) / CS; }
@@ -6,31 +6,72 @@
 #include "TaskPool.hpp"
 #include "application/Timer.hpp"
 #include "voxels/Chunk.hpp"
+#include "voxels/ChunkDiskCache.hpp"
 #include "voxels/Common.hpp"
-#include "voxels/Terrain.hpp"
+#include "voxels/PaletteChunk.hpp"
+#include "voxels/RegionStore.hpp"
+#include "voxels/WorldGenerator.hpp"
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
 struct MeshTaskEnqueue {
   uint32_t chunk_handle;
+  ivec3 pos;
+  // Without neighbor padding, the grid is the chunk's voxels with its pending edits applied
+  bool edited{};
 };
 
 struct MeshTaskResponse {
-  uint32_t output_data_handle;
-  uint32_t alg_data_handle;
   uint32_t chunk_handle;
+  // Taken from the pool on the main thread, which may grow the pool while the task runs
+  Chunk* chunk;
+  ivec3 pos;
   uint32_t staging_copy_idx;
-  void Process();
+  uint32_t vertex_cnt;
+  std::array<int, 6> face_vertex_lengths;
+  // With resident_voxels_, the chunk encoded after meshing
+  std::shared_ptr<PaletteChunk> voxels;
+  // Uniform solid chunks have no grid and are meshed from this mask, see GenerateSolidChunkMesh
+  std::shared_ptr<PaddedChunkMask> solid_mask;
+  uint8_t solid_material;
+  // Voxels edited since generation, meshed instead of loading the stored mesh
+  bool edited;
+  // Set for edited chunks, which keep their mesh per slice, see ChunkState::incremental
+  std::shared_ptr<IncrementalMeshData> incremental;
+  // incremental holds the mesh from before modified changed the grid, otherwise it's meshed whole
+  bool incremental_meshed{};
+  std::vector<ivec3> modified;
+};
+
+// Chunks meshed back-to-back by one worker. Neighboring entries of the mesh queue are neighbors in
+// the world since terrain is generated in scan order, so a batch touches nearby height maps.
+constexpr int MaxMeshBatchSize = 8;
+
+struct MeshBatchResponse {
+  std::array<MeshTaskResponse, MaxMeshBatchSize> tasks;
+  uint32_t cnt{};
+  // Taken from the edit queue, counted against the edit in flight limit
+  bool edit{};
 };
 
 struct TerrainGenTask {
   uint32_t chunk_handle;
+  // See MeshTaskResponse::chunk
+  Chunk* chunk;
   // HeightMapData* height_map;
 };
 
+// Material for a voxel in world voxel coordinates, 0 clears it.
+struct VoxelEdit {
+  ivec3 pos;
+  uint8_t material;
+};
+
 struct TerrainGenResponse {
   uint32_t grid;
   ivec3 pos;
+  // Set if every generated voxel is this one material, 0 for air
+  std::optional<uint8_t> uniform;
 };
 
 struct VoxelWorld {
@@ -43,46 +84,121 @@ struct VoxelWorld {
   void DrawImGuiStats();
   void FreeAllMeshes();
 
+  // Edits of loaded chunks, in world voxel coordinates. Every chunk holding an edited voxel, in
+  // its padding too, is remeshed ahead of streaming work and keeps drawing its old mesh until the
+  // new one is uploaded. Chunks still loading take their edits once loaded. Voxels outside the
+  // loaded area are dropped, the return values count the ones kept. Edits need the voxels to stay
+  // resident, world.resident_voxels or world.neighbor_padding, and are lost when a chunk unloads.
+  bool SetVoxel(ivec3 pos, uint8_t material);
+  size_t SetVoxels(std::span<const VoxelEdit> edits);
+  // Half open, [min, max)
+  size_t FillBox(ivec3 min, ivec3 max, uint8_t material);
+
  private:
   void ResetPools();
   struct Stats {
     size_t tot_meshes{};
     size_t tot_quads{};
+    size_t tot_mesh_batches{};
+    size_t tot_mesh_batch_chunks{};
     size_t max_mesh_tasks{};
     size_t max_terrain_tasks{};
     size_t max_terrain_done_size{};
-    size_t max_pool_size{};
-    size_t max_pool_size2{};
     size_t max_pool_size3{};
+    // resolved from the height range without generating
+    size_t air_chunks_skipped{};
+    size_t solid_chunks_skipped{};
+    // generated as a single material, grid returned to the pool right away
+    size_t uniform_chunks{};
+    size_t resident_voxel_bytes{};
+    size_t edit_remeshes{};
   } stats_;
 
   size_t max_mesh_tasks_;
+  size_t max_edit_mesh_tasks_;
   size_t max_terrain_tasks_;
   std::vector<ivec3> to_gen_terrain_tasks_;
 
   std::vector<ChunkMeshUpload> chunk_mesh_uploads_;
+  // Reads the chunk from region_store_ or chunk_cache_ if it's there, otherwise generates and
+  // stores it in chunk_cache_
+  TerrainGenResponse LoadOrGenerateTerrain(const TerrainGenTask& task);
   TerrainGenResponse ProcessTerrainTask(const TerrainGenTask& task);
-  MeshTaskResponse ProcessMeshTask(MeshTaskResponse& task);
+  void ProcessMeshBatch(MeshBatchResponse& batch);
   int seed_ = 1;
 
   PtrObjPool<Chunk> chunk_pool_;
-  PtrObjPool<MeshAlgData> mesh_alg_pool_;
-  PtrObjPool<MesherOutputData> mesher_output_data_pool_;
-  PtrObjPool<HeightMapData> height_map_pool_;
+  static constexpr uint32_t NullChunkHandle = UINT32_MAX;
+  struct ChunkEdit {
+    i8vec3 min;
+    i8vec3 max;
+    uint8_t material;
+  };
   struct ChunkState {
     uint32_t mesh_handle{};
+    // Grid kept after meshing so neighbors can copy their padding from it, only with
+    // neighbor_padding_. NullChunkHandle for chunks that aren't resident or are uniform.
+    uint32_t chunk_handle{NullChunkHandle};
     enum State : uint8_t { None, TerrainGenerated, Meshed } state{};
+    bool mesh_queued{};
+    bool mesh_in_flight{};
+    // A neighbor changed while this chunk was being meshed
+    bool remesh{};
+    // The remesh is for an edit, queued ahead of streaming
+    bool remesh_edit{};
+    // Voxels or, with neighbor padding, the padding changed since generation, the stored mesh of
+    // region_store_ no longer applies
+    bool edited{};
+    // All solid without a grid, neighbors take their padding from solid_grid_. Either resolved
+    // from the height range or generated as the single uniform_material.
+    bool uniform_solid{};
+    // 0 unless generated uniform solid, the material of its border faces with neighbor_padding_
+    uint8_t uniform_material{};
+    // Voxels kept after meshing with resident_voxels_, null for air and chunks not meshed yet
+    std::shared_ptr<const PaletteChunk> voxels;
+    // Edits not applied yet, boxes in padded coordinates
+    std::vector<ChunkEdit> edits;
+    // Edited chunks keep their mesh per slice, so later edits and padding changes only remesh the
+    // slices they touch, see RemeshVoxels. Dropped when the chunk turns out to have no faces.
+    std::shared_ptr<IncrementalMeshData> incremental;
+    // Padded positions changed since incremental was meshed
+    std::vector<ivec3> modified;
   };
   std::unordered_map<ivec3, ChunkState> chunks;
+  bool neighbor_padding_{};
+  bool resident_voxels_{};
+  // Shared stand-in grid for uniform solid chunks, all solid
+  std::unique_ptr<PaddedChunkGrid3D> solid_grid_;
+  bool ResolveWithoutTerrain(ivec3 pos);
+  void ResolveUniform(ChunkState& state, uint8_t material);
+  void SetResidentVoxels(ChunkState& state, std::shared_ptr<const PaletteChunk> voxels);
+  void AddResidentChunk(const TerrainGenResponse& response);
+  // edit queues it ahead of streaming work
+  void QueueMesh(ChunkState& state, ivec3 pos, bool edit = false);
+  void QueueUnmeshedNeighbors(ivec3 pos);
+  bool PrepareResidentMesh(ChunkState& state, ivec3 pos, MeshTaskResponse& task);
+  // The state of the chunk a mesh task is for, null if it was unloaded since. With owns_grid the
+  // task's grid must still be the chunk's, it may have been unloaded and loaded again.
+  ChunkState* TaskChunk(ivec3 pos, uint32_t chunk_handle, bool owns_grid);
+  void FinishUnpaddedMesh(ChunkState* state, const MeshTaskResponse& task,
+                          std::shared_ptr<const PaletteChunk> voxels);
+  void ApplyEdits();
+  // Hands an edited chunk's incremental mesh and the voxels changed since to its task
+  void PrepareIncrementalMesh(ChunkState& state, MeshTaskResponse& task);
+  uint32_t EditGrid(ChunkState& state, ivec3 pos);
+  void QueueEditedNeighbors(ivec3 pos, const ChunkState& state);
+  // Chunks with pending edits, may hold unloaded chunks and duplicates
+  std::vector<ivec3> edited_chunks_;
+  std::queue<MeshTaskEnqueue> edit_mesh_queue_;
+  // Part of mesh_tasks_.in_flight
+  size_t edit_mesh_tasks_in_flight_{};
   std::vector<ChunkAllocHandle> mesh_handle_alloc_buffer_;
   std::vector<uint32_t> meshes_to_delete;
-  gen::FBMNoise noise_;
-
-  HeightMapData* GetHeightMap(int x, int y);
-  std::mutex height_map_mtx_;
-  std::unordered_map<std::pair<int, int>, uint32_t> height_map_pool_idx_cache_;
+  WorldGenerator generator_;
+  ChunkDiskCache chunk_cache_;
+  RegionStore region_store_;
   TaskPool<TerrainGenTask, TerrainGenResponse> terrain_tasks_;
-  TaskPool<MeshTaskEnqueue, MeshTaskResponse> mesh_tasks_;
+  TaskPool<MeshTaskEnqueue, MeshBatchResponse> mesh_tasks_;
 
   Timer world_start_timer_;
   int world_gen_chunk_payload_{};
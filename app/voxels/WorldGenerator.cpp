@@ -0,0 +1,103 @@
+#include "WorldGenerator.hpp"
+
+#include "voxels/ChunkDiskCache.hpp"
+#include "voxels/TerrainPipeline.hpp"
+
+namespace {
+
+namespace material {
+constexpr uint8_t Grass = 64;
+constexpr uint8_t Dirt = 96;
+constexpr uint8_t Stone = 128;
+constexpr uint8_t Ore = 200;
+}  // namespace material
+
+using LayeredTerrain =
+    gen::TerrainPipeline<gen::HeightMapSource,
+                         gen::DepthLayers<material::Stone, gen::Layer<1, material::Grass>,
+                                          gen::Layer<3, material::Dirt>>,
+                         gen::OrePass<material::Stone, material::Ore, 650>>;
+
+}  // namespace
+
+void WorldGenerator::Init(const WorldGenSettings& settings, size_t height_map_budget_bytes) {
+  settings_ = settings;
+  noise_.Init(settings.seed, settings.frequency, 4);
+  density_noise_.Init(settings.seed);
+  height_maps_.Init(height_map_budget_bytes,
+                    [this](ivec3 key, HeightMapData& out) { GenerateHeightMap(key, out); });
+}
+
+uint64_t WorldGenerator::SettingsHash() const {
+  return ChunkDiskCache::HashSettings(settings_.frequency, settings_.chunks_y,
+                                      settings_.density_terrain, settings_.layered_terrain);
+}
+
+HeightMapCache::Handle WorldGenerator::GetHeightMap(int x, int z, int lod) const {
+  return height_maps_.Get({x, z, lod});
+}
+
+void WorldGenerator::GenerateHeightMap(ivec3 key, HeightMapData& out) const {
+  ZoneScoped;
+  ChunkPaddedHeightMapFloats height_map_floats;
+  // samples 2^lod voxels apart, heights stay in lod 0 voxels
+  noise_.FillNoise2D(height_map_floats, ivec2{key.x, key.y} * CS, uvec2{PCS},
+                     static_cast<float>(2 << key.z));
+  gen::NoiseToHeights(height_map_floats, out, HeightRange());
+}
+
+uvec2 WorldGenerator::HeightRange() const {
+  return {0, static_cast<uint32_t>((settings_.chunks_y * CS * 0.5) - 1)};
+}
+
+WorldGenerator::ChunkFill WorldGenerator::ClassifyChunk(ivec3 chunk_pos) const {
+  ivec2 range{HeightRange()};
+  if (auto height_map = height_maps_.Find({chunk_pos.x, chunk_pos.z, 0})) {
+    range = height_map->range;
+  }
+  // voxels at world height y are solid below the column height, padded layer 0 is at y_low
+  const int y_low = chunk_pos.y * CS;
+  const int y_high = y_low + PCS - 1;
+  if (settings_.density_terrain) {
+    // the surface noise lifts the surface up to surface_falloff voxels, caves rule out solid
+    const bool above = static_cast<float>(y_low) >=
+                       static_cast<float>(range.y) + density_noise_.surface_falloff;
+    return above ? ChunkFill::Air : ChunkFill::Unknown;
+  }
+  if (y_low >= range.y) return ChunkFill::Air;
+  if (y_high < range.x) return ChunkFill::Solid;
+  return ChunkFill::Unknown;
+}
+
+void WorldGenerator::FillChunk(PaddedChunkGrid3D& grid, ivec3 chunk_pos, int lod, int first,
+                               int last) const {
+  ZoneScoped;
+  constexpr uint8_t Material = 128;
+  auto height_map = GetHeightMap(chunk_pos.x, chunk_pos.z, lod);
+  // in voxels of this lod
+  const ivec3 chunk_start = chunk_pos * CS;
+  if (lod == 0 && settings_.density_terrain) {
+    density_noise_.FillChunk(grid, chunk_start, *height_map, Material, first, last);
+    return;
+  }
+  if (!settings_.layered_terrain) {
+    gen::FillChunkColumns(grid, height_map->heights, chunk_start.y << lod, 1 << lod, Material,
+                          first, last);
+    return;
+  }
+  const HeightMapData* heights = height_map.get();
+  HeightMapData lod_heights;
+  if (lod > 0) {
+    // a voxel of this lod is solid if its bottom is below the surface, round heights up
+    const int round = (1 << lod) - 1;
+    for (int i = 0; i < PCS2; i++) {
+      lod_heights.heights[i] = (height_map->heights[i] + round) >> lod;
+    }
+    lod_heights.range = {(height_map->range.x + round) >> lod,
+                         (height_map->range.y + round) >> lod};
+    heights = &lod_heights;
+  }
+  const LayeredTerrain pipeline{gen::HeightMapSource{heights}, {},
+                                {.seed = static_cast<uint32_t>(settings_.seed)}};
+  pipeline.Fill(grid, chunk_start, first, last);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "voxels/Chunk.hpp"
+#include "voxels/HeightMapCache.hpp"
+#include "voxels/Terrain.hpp"
+
+struct WorldGenSettings {
+  int seed{1};
+  float frequency{0.002};
+  // height maps span chunks_y * CS / 2 voxels
+  int chunks_y{1};
+  bool density_terrain{};
+  bool layered_terrain{};
+};
+
+// Chunk generation of VoxelWorld without any renderer state, so headless tools generate the same
+// terrain as the app. Chunk (x, y, z) at lod k covers CS * 2^k world voxels per axis, its voxels
+// 2^k apart. FillChunk is safe to call from any number of threads.
+class WorldGenerator {
+ public:
+  // Bump whenever generation changes its output for the same settings, so stored chunks from an
+  // older generator aren't loaded.
+  static constexpr uint32_t Version = 3;
+
+  // Not thread safe, call with no fills in flight.
+  void Init(const WorldGenSettings& settings, size_t height_map_budget_bytes);
+  // Expects a cleared grid. Only voxels within [first, last] on every axis are written. Lods above
+  // 0 use the lod's height map at its voxel spacing; density terrain falls back to height columns
+  // there.
+  void FillChunk(PaddedChunkGrid3D& grid, ivec3 chunk_pos, int lod, int first = 0,
+                 int last = PCS - 1) const;
+  [[nodiscard]] HeightMapCache::Handle GetHeightMap(int x, int z, int lod) const;
+
+  // What FillChunk produces for a whole padded lod 0 chunk, when it's known without running it.
+  // Solid means every voxel, padding included, is solid, so the chunk has no visible faces.
+  enum class ChunkFill : uint8_t { Unknown, Air, Solid };
+  // Bounds the chunk by its column's height range if the height map is cached and by the range
+  // every height map is clamped to otherwise. Never generates, cheap enough for the scheduler.
+  [[nodiscard]] ChunkFill ClassifyChunk(ivec3 chunk_pos) const;
+
+  [[nodiscard]] const WorldGenSettings& Settings() const { return settings_; }
+  // Identifies the generated output together with Version and the seed.
+  [[nodiscard]] uint64_t SettingsHash() const;
+  [[nodiscard]] const HeightMapCache& HeightMaps() const { return height_maps_; }
+
+ private:
+  void GenerateHeightMap(ivec3 key, HeightMapData& out) const;
+  [[nodiscard]] uvec2 HeightRange() const;
+
+  WorldGenSettings settings_;
+  gen::FBMNoise noise_;
+  gen::DensityNoise density_noise_;
+  // keyed by (chunk x, chunk z, lod)
+  mutable HeightMapCache height_maps_;
+};